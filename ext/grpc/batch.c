@@ -0,0 +1,238 @@
+/*
+ *
+ * Copyright 2015, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "batch.h"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <php.h>
+#include <php_ini.h>
+#include <ext/standard/info.h>
+#include <ext/spl/spl_exceptions.h>
+#include "php_grpc.h"
+
+#include <zend_exceptions.h>
+
+#include <stdbool.h>
+
+#include <grpc/grpc.h>
+
+zend_class_entry *grpc_ce_batch;
+zend_class_entry *grpc_ce_batch_result;
+static zend_object_handlers batch_ce_handlers;
+static zend_object_handlers batch_result_ce_handlers;
+
+/* The names of the BatchResult properties, in slot order */
+static const char *batch_result_property_names[] = {
+  "send_metadata",
+  "send_message",
+  "send_close",
+  "send_status",
+  "metadata",
+  "message",
+  "status",
+  "cancelled",
+  "operation",
+  "timed_out"
+};
+
+/* Frees and destroys an instance of wrapped_grpc_batch */
+static void free_wrapped_grpc_batch(zend_object *object) {
+  wrapped_grpc_batch *batch = wrapped_grpc_batch_from_obj(object);
+  zend_object_std_dtor(&batch->std);
+}
+
+/* Initializes an instance of wrapped_grpc_batch to be associated with an
+ * object of a class specified by class_type */
+zend_object *create_wrapped_grpc_batch(zend_class_entry *class_type) {
+  wrapped_grpc_batch *intern;
+  intern = ecalloc(1, sizeof(wrapped_grpc_batch) +
+                   zend_object_properties_size(class_type));
+  zend_object_std_init(&intern->std, class_type);
+  object_properties_init(&intern->std, class_type);
+  intern->std.handlers = &batch_ce_handlers;
+  return &intern->std;
+}
+
+/* Creates a BatchResult object with its declared properties, and handlers
+ * that do not allow cloning it */
+static zend_object *create_grpc_batch_result(zend_class_entry *class_type) {
+  zend_object *intern = zend_objects_new(class_type);
+  object_properties_init(intern, class_type);
+  intern->handlers = &batch_result_ce_handlers;
+  return intern;
+}
+
+void grpc_php_batch_result_init(zval *result) {
+  object_init_ex(result, grpc_ce_batch_result);
+}
+
+void grpc_php_batch_result_set(zval *result,
+                               grpc_php_batch_result_property property,
+                               zval *value) {
+  /* Declared properties live in the object itself, so this writes the slot
+   * directly instead of looking the name up */
+  zval *slot = OBJ_PROP_NUM(Z_OBJ_P(result), property);
+  zval_ptr_dtor(slot);
+  ZVAL_COPY_VALUE(slot, value);
+}
+
+/**
+ * Constructs a reusable batch template. The ops are given as for
+ * Call::startBatch, but only with the options that stay the same from one
+ * run to the next: true for most ops, ['flags' => $flags] for
+ * OP_SEND_MESSAGE and ['byte_buffer' => true] for OP_RECV_MESSAGE. The
+ * values that change are passed to Call::runBatch, in the order of the ops:
+ * the metadata array for OP_SEND_INITIAL_METADATA, the message string for
+ * OP_SEND_MESSAGE, and the trailing metadata array, the code and the
+ * details for OP_SEND_STATUS_FROM_SERVER. A Batch is constructed once and
+ * never changes after that.
+ * @param array $ops The ops of the batch
+ */
+PHP_METHOD(Batch, __construct) {
+  wrapped_grpc_batch *batch = Z_WRAPPED_GRPC_BATCH_P(getThis());
+  zval *array;
+  zval *value;
+  zval *option;
+  zend_string *key;
+  zend_ulong index;
+  grpc_php_batch_op *op;
+
+  /* "a" == 1 array */
+  if (zend_parse_parameters(ZEND_NUM_ARGS(), "a", &array) == FAILURE) {
+    zend_throw_exception(spl_ce_InvalidArgumentException,
+                         "Batch expects an array", 1);
+    return;
+  }
+  if (batch->constructed) {
+    zend_throw_exception(spl_ce_LogicException,
+                         "Batch is already constructed", 1);
+    return;
+  }
+  batch->constructed = true;
+
+  ZEND_HASH_FOREACH_KEY_VAL(Z_ARRVAL_P(array), index, key, value) {
+    if (key || index > GRPC_OP_RECV_CLOSE_ON_SERVER ||
+        batch->op_num == GRPC_PHP_BATCH_MAX_OPS) {
+      zend_throw_exception(spl_ce_InvalidArgumentException,
+                           "Unrecognized key in batch", 1);
+      goto failed;
+    }
+    op = &batch->ops[batch->op_num++];
+    op->op = (grpc_op_type)index;
+    switch(index) {
+    case GRPC_OP_SEND_INITIAL_METADATA:
+      batch->arg_num++;
+      break;
+    case GRPC_OP_SEND_MESSAGE:
+      if (Z_TYPE_P(value) == IS_ARRAY &&
+          (option = zend_hash_str_find(Z_ARRVAL_P(value), "flags",
+                                       sizeof("flags") - 1)) != NULL) {
+        if (Z_TYPE_P(option) != IS_LONG) {
+          zend_throw_exception(spl_ce_InvalidArgumentException,
+                               "Expected an int for message flags", 1);
+          goto failed;
+        }
+        op->flags = Z_LVAL_P(option) & GRPC_WRITE_USED_MASK;
+      }
+      batch->arg_num++;
+      break;
+    case GRPC_OP_SEND_STATUS_FROM_SERVER:
+      batch->arg_num += 3;
+      break;
+    case GRPC_OP_RECV_MESSAGE:
+      if (Z_TYPE_P(value) == IS_ARRAY &&
+          (option = zend_hash_str_find(Z_ARRVAL_P(value), "byte_buffer",
+                                       sizeof("byte_buffer") - 1)) != NULL) {
+        op->byte_buffer = zend_is_true(option);
+      }
+      break;
+    default:
+      break;
+    }
+  }
+  ZEND_HASH_FOREACH_END();
+  return;
+
+failed:
+  /* Runs of a half parsed batch would send the wrong ops */
+  batch->op_num = 0;
+  batch->arg_num = 0;
+}
+
+/**
+ * Get the number of values a run of this batch takes
+ * @return long The number of arguments for Call::runBatch
+ */
+PHP_METHOD(Batch, getArgumentCount) {
+  wrapped_grpc_batch *batch = Z_WRAPPED_GRPC_BATCH_P(getThis());
+  RETURN_LONG(batch->arg_num);
+}
+
+static zend_function_entry batch_methods[] = {
+  PHP_ME(Batch, __construct, NULL, ZEND_ACC_PUBLIC)
+  PHP_ME(Batch, getArgumentCount, NULL, ZEND_ACC_PUBLIC)
+  PHP_FE_END
+};
+
+void grpc_init_batch() {
+  zend_class_entry ce;
+  size_t i;
+
+  INIT_CLASS_ENTRY(ce, "Grpc\\Batch", batch_methods);
+  ce.create_object = create_wrapped_grpc_batch;
+  grpc_ce_batch = zend_register_internal_class(&ce);
+  memcpy(&batch_ce_handlers, zend_get_std_object_handlers(),
+         sizeof(zend_object_handlers));
+  batch_ce_handlers.offset = XtOffsetOf(wrapped_grpc_batch, std);
+  batch_ce_handlers.free_obj = free_wrapped_grpc_batch;
+  /* A clone would not be a wrapped_grpc_batch */
+  batch_ce_handlers.clone_obj = NULL;
+
+  INIT_CLASS_ENTRY(ce, "Grpc\\BatchResult", NULL);
+  ce.create_object = create_grpc_batch_result;
+  grpc_ce_batch_result = zend_register_internal_class(&ce);
+  memcpy(&batch_result_ce_handlers, zend_get_std_object_handlers(),
+         sizeof(zend_object_handlers));
+  /* A result holds the Operation of a batch still in flight, which is not
+   * to be shared between copies */
+  batch_result_ce_handlers.clone_obj = NULL;
+  for (i = 0; i < GRPC_PHP_RESULT_PROPERTY_COUNT; i++) {
+    zend_declare_property_null(grpc_ce_batch_result,
+                               batch_result_property_names[i],
+                               strlen(batch_result_property_names[i]),
+                               ZEND_ACC_PUBLIC);
+  }
+}
@@ -0,0 +1,114 @@
+/*
+ *
+ * Copyright 2015, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef NET_GRPC_PHP_GRPC_BATCH_H_
+#define NET_GRPC_PHP_GRPC_BATCH_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <php.h>
+#include <php_ini.h>
+#include <ext/standard/info.h>
+#include "php_grpc.h"
+
+#include <stdbool.h>
+
+#include <grpc/grpc.h>
+
+/* Class entries for the Batch and BatchResult PHP classes */
+extern zend_class_entry *grpc_ce_batch;
+extern zend_class_entry *grpc_ce_batch_result;
+
+/* One op of a batch template, with the options that do not change from one
+ * run of the template to the next */
+typedef struct grpc_php_batch_op {
+  grpc_op_type op;
+  uint32_t flags;
+  /* For GRPC_OP_RECV_MESSAGE: return the message as a ByteBuffer */
+  bool byte_buffer;
+} grpc_php_batch_op;
+
+/* A batch has at most one op of each type */
+#define GRPC_PHP_BATCH_MAX_OPS (GRPC_OP_RECV_CLOSE_ON_SERVER + 1)
+
+/* Wrapper struct for a parsed batch template that can be associated with a
+ * PHP object */
+typedef struct wrapped_grpc_batch {
+  grpc_php_batch_op ops[GRPC_PHP_BATCH_MAX_OPS];
+  size_t op_num;
+  /* The number of arguments a run of the template takes */
+  size_t arg_num;
+  /* Set by the constructor, which may only run once */
+  bool constructed;
+  zend_object std;
+} wrapped_grpc_batch;
+
+static inline wrapped_grpc_batch
+*wrapped_grpc_batch_from_obj(zend_object *obj) {
+  return (wrapped_grpc_batch*)((char*)(obj) -
+                               XtOffsetOf(wrapped_grpc_batch, std));
+}
+
+#define Z_WRAPPED_GRPC_BATCH_P(zv)            \
+  wrapped_grpc_batch_from_obj(Z_OBJ_P((zv)))
+
+/* The declared properties of BatchResult, in declaration order, so that
+ * each one is at a fixed slot of the object */
+typedef enum grpc_php_batch_result_property {
+  GRPC_PHP_RESULT_SEND_METADATA,
+  GRPC_PHP_RESULT_SEND_MESSAGE,
+  GRPC_PHP_RESULT_SEND_CLOSE,
+  GRPC_PHP_RESULT_SEND_STATUS,
+  GRPC_PHP_RESULT_METADATA,
+  GRPC_PHP_RESULT_MESSAGE,
+  GRPC_PHP_RESULT_STATUS,
+  GRPC_PHP_RESULT_CANCELLED,
+  GRPC_PHP_RESULT_OPERATION,
+  GRPC_PHP_RESULT_TIMED_OUT,
+  GRPC_PHP_RESULT_PROPERTY_COUNT
+} grpc_php_batch_result_property;
+
+/* Initializes the Batch and BatchResult PHP classes */
+void grpc_init_batch();
+
+/* Creates an empty BatchResult object */
+void grpc_php_batch_result_init(zval *result);
+
+/* Sets a property of a BatchResult object, taking over the value */
+void grpc_php_batch_result_set(zval *result,
+                               grpc_php_batch_result_property property,
+                               zval *value);
+
+#endif /* NET_GRPC_PHP_GRPC_BATCH_H_ */
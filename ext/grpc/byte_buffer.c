@@ -41,13 +41,21 @@
 #include <ext/spl/spl_exceptions.h>
 #include "php_grpc.h"
 
+#include <zend_exceptions.h>
+#include <zend_interfaces.h>
+
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "byte_buffer.h"
 
 #include <grpc/grpc.h>
 #include <grpc/byte_buffer_reader.h>
+#include <grpc/support/alloc.h>
 #include <grpc/support/slice.h>
+#include <grpc/support/slice_buffer.h>
 
 grpc_byte_buffer *string_to_byte_buffer(char *string, size_t length) {
   gpr_slice slice = gpr_slice_from_copied_buffer(string, length);
@@ -56,22 +64,404 @@ grpc_byte_buffer *string_to_byte_buffer(char *string, size_t length) {
   return buffer;
 }
 
-void byte_buffer_to_string(grpc_byte_buffer *buffer, char **out_string,
-                           size_t *out_length) {
+/* A mapped region of a file referenced by a slice. It does not belong to
+ * the request, so core can unmap it from any thread */
+typedef struct grpc_php_mapping {
+  void *start;
+  size_t length;
+} grpc_php_mapping;
+
+static void unmap_region(void *user_data) {
+  grpc_php_mapping *mapping = (grpc_php_mapping *)user_data;
+  munmap(mapping->start, mapping->length);
+  gpr_free(mapping);
+}
+
+/* Maps length bytes of a regular file from offset into a byte buffer.
+ * Returns NULL if the stream is not a plain file or cannot be mapped.
+ * The file must not be truncated while core sends it: reading a page past
+ * the new end of the file raises SIGBUS */
+static grpc_byte_buffer *mapped_byte_buffer(php_stream *stream,
+                                            size_t offset, size_t length) {
+  int fd;
+  size_t page_offset;
+  void *start;
+  grpc_php_mapping *mapping;
+  gpr_slice slice;
+  grpc_byte_buffer *buffer;
+
+  if (length == 0 || !php_stream_can_cast(stream, PHP_STREAM_AS_FD) ||
+      php_stream_cast(stream, PHP_STREAM_AS_FD, (void **)&fd, 0) != SUCCESS) {
+    return NULL;
+  }
+  /* mmap offsets must be page aligned */
+  page_offset = offset % sysconf(_SC_PAGESIZE);
+  start = mmap(NULL, length + page_offset, PROT_READ, MAP_PRIVATE, fd,
+               offset - page_offset);
+  if (start == MAP_FAILED) {
+    return NULL;
+  }
+  mapping = gpr_malloc(sizeof(grpc_php_mapping));
+  mapping->start = start;
+  mapping->length = length + page_offset;
+  slice = gpr_slice_new_with_user_data((char *)start + page_offset, length,
+                                       unmap_region, mapping);
+  buffer = grpc_raw_byte_buffer_create(&slice, 1);
+  gpr_slice_unref(slice);
+  return buffer;
+}
+
+/* Reads up to length bytes of a stream into a byte buffer, in slices of
+ * GRPC_PHP_STREAM_CHUNK_SIZE bytes. A negative length reads to the end */
+static grpc_byte_buffer *read_byte_buffer(php_stream *stream,
+                                          zend_long length) {
+  gpr_slice_buffer slices;
+  gpr_slice slice;
+  size_t want;
+  ssize_t got;
+  grpc_byte_buffer *buffer;
+
+  gpr_slice_buffer_init(&slices);
+  while (length != 0 && !php_stream_eof(stream)) {
+    want = GRPC_PHP_STREAM_CHUNK_SIZE;
+    if (length > 0 && (size_t)length < want) {
+      want = length;
+    }
+    slice = gpr_slice_malloc(want);
+    /* Returns -1 on errors since PHP 7.4 */
+    got = php_stream_read(stream, (char *)GPR_SLICE_START_PTR(slice), want);
+    if (got <= 0) {
+      gpr_slice_unref(slice);
+      if (got < 0) {
+        gpr_slice_buffer_destroy(&slices);
+        return NULL;
+      }
+      break;
+    }
+    gpr_slice_buffer_add(&slices, gpr_slice_sub_no_ref(slice, 0, got));
+    if (length > 0) {
+      length -= got;
+    }
+  }
+  if (length > 0) {
+    /* The stream ended before the requested range */
+    gpr_slice_buffer_destroy(&slices);
+    return NULL;
+  }
+  buffer = grpc_raw_byte_buffer_create(slices.slices, slices.count);
+  gpr_slice_buffer_destroy(&slices);
+  return buffer;
+}
+
+grpc_byte_buffer *stream_to_byte_buffer(php_stream *stream, zend_long offset,
+                                        zend_long length) {
+  php_stream_statbuf ssb;
+  grpc_byte_buffer *buffer;
+
+  if (offset < 0) {
+    offset = php_stream_tell(stream);
+  }
+  if (php_stream_stat(stream, &ssb) == 0 && S_ISREG(ssb.sb.st_mode)) {
+    if (offset > ssb.sb.st_size ||
+        (length >= 0 && length > ssb.sb.st_size - offset)) {
+      return NULL;
+    }
+    if (length < 0) {
+      length = ssb.sb.st_size - offset;
+    }
+    buffer = mapped_byte_buffer(stream, offset, length);
+    if (buffer != NULL) {
+      /* Leave the stream after the sent range, as reading it would */
+      php_stream_seek(stream, offset + length, SEEK_SET);
+      return buffer;
+    }
+  }
+  if (offset != php_stream_tell(stream) &&
+      php_stream_seek(stream, offset, SEEK_SET) != 0) {
+    return NULL;
+  }
+  return read_byte_buffer(stream, length);
+}
+
+zend_string *byte_buffer_to_zend_string(grpc_byte_buffer *buffer) {
   grpc_byte_buffer_reader reader;
+  gpr_slice slice;
+  zend_string *string;
+  size_t offset = 0;
+
   if (buffer == NULL || !grpc_byte_buffer_reader_init(&reader, buffer)) {
     /* TODO(dgq): distinguish between the error cases. */
-    *out_string = NULL;
-    *out_length = 0;
+    return NULL;
+  }
+
+  /* The reader decompresses into buffer_out, so that has the final size */
+  string = zend_string_alloc(grpc_byte_buffer_length(reader.buffer_out), 0);
+  while (grpc_byte_buffer_reader_next(&reader, &slice)) {
+    memcpy(ZSTR_VAL(string) + offset, GPR_SLICE_START_PTR(slice),
+           GPR_SLICE_LENGTH(slice));
+    offset += GPR_SLICE_LENGTH(slice);
+    gpr_slice_unref(slice);
+  }
+  grpc_byte_buffer_reader_destroy(&reader);
+  ZSTR_VAL(string)[offset] = '\0';
+  return string;
+}
+
+zend_class_entry *grpc_ce_byte_buffer;
+static zend_object_handlers byte_buffer_ce_handlers;
+
+/* Frees and destroys an instance of wrapped_grpc_byte_buffer */
+static void free_wrapped_grpc_byte_buffer(zend_object *object) {
+  wrapped_grpc_byte_buffer *buffer =
+    wrapped_grpc_byte_buffer_from_obj(object);
+  if (buffer->wrapped != NULL) {
+    grpc_byte_buffer_destroy(buffer->wrapped);
+  }
+  zend_object_std_dtor(&buffer->std);
+}
+
+/* Initializes an instance of wrapped_grpc_byte_buffer to be associated with
+ * an object of a class specified by class_type */
+zend_object *create_wrapped_grpc_byte_buffer(zend_class_entry *class_type) {
+  wrapped_grpc_byte_buffer *intern;
+  intern = ecalloc(1, sizeof(wrapped_grpc_byte_buffer) +
+                   zend_object_properties_size(class_type));
+  zend_object_std_init(&intern->std, class_type);
+  object_properties_init(&intern->std, class_type);
+  intern->std.handlers = &byte_buffer_ce_handlers;
+  return &intern->std;
+}
+
+void grpc_php_wrap_byte_buffer(grpc_byte_buffer *buffer,
+                               zval *byte_buffer_object) {
+  grpc_byte_buffer_reader reader;
+  gpr_slice_buffer slices;
+  gpr_slice slice;
+  wrapped_grpc_byte_buffer *wrapped;
+
+  object_init_ex(byte_buffer_object, grpc_ce_byte_buffer);
+  wrapped = Z_WRAPPED_GRPC_BYTE_BUFFER_P(byte_buffer_object);
+  /* Slices are indexed directly, so the object keeps an uncompressed
+   * buffer. Its slices are references to the reader's, not copies */
+  gpr_slice_buffer_init(&slices);
+  if (grpc_byte_buffer_reader_init(&reader, buffer)) {
+    while (grpc_byte_buffer_reader_next(&reader, &slice)) {
+      gpr_slice_buffer_add(&slices, slice);
+    }
+    grpc_byte_buffer_reader_destroy(&reader);
+  }
+  wrapped->wrapped = grpc_raw_byte_buffer_create(slices.slices, slices.count);
+  gpr_slice_buffer_destroy(&slices);
+  grpc_byte_buffer_destroy(buffer);
+}
+
+/* Returns the slices of the message, or NULL with an exception thrown if
+ * the object holds no message */
+static gpr_slice_buffer *byte_buffer_slices(wrapped_grpc_byte_buffer *buffer) {
+  if (buffer->wrapped == NULL) {
+    zend_throw_exception(spl_ce_LogicException,
+                         "ByteBuffer holds no message", 1);
+    return NULL;
+  }
+  return &buffer->wrapped->data.raw.slice_buffer;
+}
+
+/**
+ * ByteBuffers are only created by the extension, for received messages
+ */
+PHP_METHOD(ByteBuffer, __construct) {
+}
+
+/**
+ * Get the size of the message
+ * @return long The number of bytes in the message
+ */
+PHP_METHOD(ByteBuffer, length) {
+  wrapped_grpc_byte_buffer *buffer = Z_WRAPPED_GRPC_BYTE_BUFFER_P(getThis());
+  gpr_slice_buffer *slices = byte_buffer_slices(buffer);
+  if (slices == NULL) {
     return;
   }
+  RETURN_LONG(slices->length);
+}
 
-  gpr_slice slice = grpc_byte_buffer_reader_readall(&reader);
-  size_t length = GPR_SLICE_LENGTH(slice);
-  char *string = ecalloc(length + 1, sizeof(char));
-  memcpy(string, GPR_SLICE_START_PTR(slice), length);
-  gpr_slice_unref(slice);
+/**
+ * Read part of the message, without building the rest of it as a string
+ * @param long $offset The position of the first byte to read (optional)
+ * @param long $length The number of bytes to read. Defaults to the rest of
+ *     the message (optional)
+ * @return string The bytes read
+ */
+PHP_METHOD(ByteBuffer, read) {
+  wrapped_grpc_byte_buffer *buffer = Z_WRAPPED_GRPC_BYTE_BUFFER_P(getThis());
+  gpr_slice_buffer *slices;
+  zend_long offset = 0;
+  zend_long length = -1;
+  zend_string *string;
+  size_t copied = 0;
+  size_t slice_length;
+  size_t start;
+  size_t count;
+  size_t i;
+
+  /* "|ll" == 2 optional longs */
+  if (zend_parse_parameters(ZEND_NUM_ARGS(), "|ll", &offset, &length) ==
+      FAILURE) {
+    zend_throw_exception(spl_ce_InvalidArgumentException,
+                         "read expects 2 optional longs", 1);
+    return;
+  }
+  slices = byte_buffer_slices(buffer);
+  if (slices == NULL) {
+    return;
+  }
+  if (offset < 0 || (size_t)offset > slices->length) {
+    zend_throw_exception(spl_ce_InvalidArgumentException,
+                         "read offset is out of range", 1);
+    return;
+  }
+  if (length < 0 || (size_t)length > slices->length - offset) {
+    length = slices->length - offset;
+  }
+
+  string = zend_string_alloc(length, 0);
+  for (i = 0; i < slices->count && copied < (size_t)length; i++) {
+    slice_length = GPR_SLICE_LENGTH(slices->slices[i]);
+    if ((size_t)offset >= slice_length) {
+      offset -= slice_length;
+      continue;
+    }
+    start = offset;
+    count = MIN(slice_length - start, length - copied);
+    memcpy(ZSTR_VAL(string) + copied,
+           GPR_SLICE_START_PTR(slices->slices[i]) + start, count);
+    copied += count;
+    offset = 0;
+  }
+  ZSTR_VAL(string)[copied] = '\0';
+  RETURN_NEW_STR(string);
+}
+
+/**
+ * Write the whole message to a stream, one slice at a time
+ * @param resource $stream The stream to write to
+ * @return long The number of bytes written
+ */
+PHP_METHOD(ByteBuffer, writeTo) {
+  wrapped_grpc_byte_buffer *buffer = Z_WRAPPED_GRPC_BYTE_BUFFER_P(getThis());
+  gpr_slice_buffer *slices;
+  zval *stream_zval;
+  php_stream *stream;
+  size_t written = 0;
+  size_t i;
+
+  /* "r" == 1 resource */
+  if (zend_parse_parameters(ZEND_NUM_ARGS(), "r", &stream_zval) ==
+      FAILURE) {
+    zend_throw_exception(spl_ce_InvalidArgumentException,
+                         "writeTo expects a stream", 1);
+    return;
+  }
+  slices = byte_buffer_slices(buffer);
+  if (slices == NULL) {
+    return;
+  }
+  php_stream_from_zval(stream, stream_zval);
+  for (i = 0; i < slices->count; i++) {
+    if (php_stream_write(stream,
+                         (char *)GPR_SLICE_START_PTR(slices->slices[i]),
+                         GPR_SLICE_LENGTH(slices->slices[i])) !=
+        GPR_SLICE_LENGTH(slices->slices[i])) {
+      zend_throw_exception(spl_ce_RuntimeException,
+                           "Failed to write the message to the stream", 1);
+      return;
+    }
+    written += GPR_SLICE_LENGTH(slices->slices[i]);
+  }
+  RETURN_LONG(written);
+}
+
+/**
+ * Iterator methods, over the slices of the message as strings
+ */
+PHP_METHOD(ByteBuffer, rewind) {
+  wrapped_grpc_byte_buffer *buffer = Z_WRAPPED_GRPC_BYTE_BUFFER_P(getThis());
+  buffer->position = 0;
+}
+
+PHP_METHOD(ByteBuffer, valid) {
+  wrapped_grpc_byte_buffer *buffer = Z_WRAPPED_GRPC_BYTE_BUFFER_P(getThis());
+  gpr_slice_buffer *slices = byte_buffer_slices(buffer);
+  if (slices == NULL) {
+    return;
+  }
+  RETURN_BOOL(buffer->position < slices->count);
+}
+
+PHP_METHOD(ByteBuffer, current) {
+  wrapped_grpc_byte_buffer *buffer = Z_WRAPPED_GRPC_BYTE_BUFFER_P(getThis());
+  gpr_slice_buffer *slices = byte_buffer_slices(buffer);
+  if (slices == NULL) {
+    return;
+  }
+  if (buffer->position >= slices->count) {
+    RETURN_NULL();
+  }
+  RETURN_STRINGL(
+      (char *)GPR_SLICE_START_PTR(slices->slices[buffer->position]),
+      GPR_SLICE_LENGTH(slices->slices[buffer->position]));
+}
+
+PHP_METHOD(ByteBuffer, key) {
+  wrapped_grpc_byte_buffer *buffer = Z_WRAPPED_GRPC_BYTE_BUFFER_P(getThis());
+  RETURN_LONG(buffer->position);
+}
+
+PHP_METHOD(ByteBuffer, next) {
+  wrapped_grpc_byte_buffer *buffer = Z_WRAPPED_GRPC_BYTE_BUFFER_P(getThis());
+  buffer->position++;
+}
+
+/**
+ * Copy the whole message into a string
+ * @return string The message, empty if there is none
+ */
+PHP_METHOD(ByteBuffer, __toString) {
+  wrapped_grpc_byte_buffer *buffer = Z_WRAPPED_GRPC_BYTE_BUFFER_P(getThis());
+  zend_string *string = byte_buffer_to_zend_string(buffer->wrapped);
+  /* __toString must not throw */
+  if (string == NULL) {
+    RETURN_EMPTY_STRING();
+  }
+  RETURN_STR(string);
+}
+
+static zend_function_entry byte_buffer_methods[] = {
+  PHP_ME(ByteBuffer, __construct, NULL, ZEND_ACC_PRIVATE)
+  PHP_ME(ByteBuffer, length, NULL, ZEND_ACC_PUBLIC)
+  PHP_ME(ByteBuffer, read, NULL, ZEND_ACC_PUBLIC)
+  PHP_ME(ByteBuffer, writeTo, NULL, ZEND_ACC_PUBLIC)
+  PHP_ME(ByteBuffer, rewind, NULL, ZEND_ACC_PUBLIC)
+  PHP_ME(ByteBuffer, valid, NULL, ZEND_ACC_PUBLIC)
+  PHP_ME(ByteBuffer, current, NULL, ZEND_ACC_PUBLIC)
+  PHP_ME(ByteBuffer, key, NULL, ZEND_ACC_PUBLIC)
+  PHP_ME(ByteBuffer, next, NULL, ZEND_ACC_PUBLIC)
+  PHP_ME(ByteBuffer, __toString, NULL, ZEND_ACC_PUBLIC)
+  PHP_FE_END
+};
 
-  *out_string = string;
-  *out_length = length;
+void grpc_init_byte_buffer() {
+  zend_class_entry ce;
+  INIT_CLASS_ENTRY(ce, "Grpc\\ByteBuffer", byte_buffer_methods);
+  /* Only created by the extension, for received messages */
+  ce.create_object = create_wrapped_grpc_byte_buffer;
+  ce.ce_flags |= ZEND_ACC_FINAL;
+  grpc_ce_byte_buffer = zend_register_internal_class(&ce);
+  zend_class_implements(grpc_ce_byte_buffer, 1, zend_ce_iterator);
+  memcpy(&byte_buffer_ce_handlers, zend_get_std_object_handlers(),
+         sizeof(zend_object_handlers));
+  byte_buffer_ce_handlers.offset = XtOffsetOf(wrapped_grpc_byte_buffer, std);
+  byte_buffer_ce_handlers.free_obj = free_wrapped_grpc_byte_buffer;
+  /* A clone would not be a wrapped_grpc_byte_buffer */
+  byte_buffer_ce_handlers.clone_obj = NULL;
 }
@@ -34,11 +34,56 @@
 #ifndef NET_GRPC_PHP_GRPC_BYTE_BUFFER_H_
 #define NET_GRPC_PHP_GRPC_BYTE_BUFFER_H_
 
+#include <php.h>
+
 #include <grpc/grpc.h>
 
 grpc_byte_buffer *string_to_byte_buffer(char *string, size_t length);
 
-void byte_buffer_to_string(grpc_byte_buffer *buffer, char **out_string,
-                           size_t *out_length);
+/* The size of the slices a byte buffer is read into from a stream that
+ * cannot be mapped */
+#define GRPC_PHP_STREAM_CHUNK_SIZE 65536
+
+/* Creates a byte buffer from length bytes of a stream, starting at offset.
+ * Regular files are mapped into memory instead of read. A negative offset
+ * starts at the current position and a negative length goes to the end of
+ * the stream. Returns NULL if the range cannot be read or the stream fails.
+ * A mapped file must not be truncated until the message has been sent */
+grpc_byte_buffer *stream_to_byte_buffer(php_stream *stream, zend_long offset,
+                                        zend_long length);
+
+/* Copies a received byte buffer into a new PHP string, slice by slice.
+ * Returns NULL if there is no buffer */
+zend_string *byte_buffer_to_zend_string(grpc_byte_buffer *buffer);
+
+/* Class entry for the ByteBuffer PHP class */
+extern zend_class_entry *grpc_ce_byte_buffer;
+
+/* Wrapper struct for an uncompressed grpc_byte_buffer that can be
+ * associated with a PHP object */
+typedef struct wrapped_grpc_byte_buffer {
+  grpc_byte_buffer *wrapped;
+  /* The slice the object's iterator is at */
+  size_t position;
+  zend_object std;
+} wrapped_grpc_byte_buffer;
+
+static inline wrapped_grpc_byte_buffer
+*wrapped_grpc_byte_buffer_from_obj(zend_object *obj) {
+  return (wrapped_grpc_byte_buffer*)((char*)(obj) -
+                                     XtOffsetOf(wrapped_grpc_byte_buffer,
+                                                std));
+}
+
+#define Z_WRAPPED_GRPC_BYTE_BUFFER_P(zv)            \
+  wrapped_grpc_byte_buffer_from_obj(Z_OBJ_P((zv)))
+
+/* Initializes the ByteBuffer PHP class */
+void grpc_init_byte_buffer();
+
+/* Creates a ByteBuffer object for a received byte buffer. Takes ownership
+ * of the buffer */
+void grpc_php_wrap_byte_buffer(grpc_byte_buffer *buffer,
+                               zval *byte_buffer_object);
 
 #endif /* NET_GRPC_PHP_GRPC_BYTE_BUFFER_H_ */
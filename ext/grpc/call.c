@@ -41,11 +41,13 @@
 #include <php_ini.h>
 #include <ext/standard/info.h>
 #include <ext/spl/spl_exceptions.h>
+#include <ext/spl/spl_iterators.h>
 #include "php_grpc.h"
 #include "call_credentials.h"
 
 #include <zend_exceptions.h>
 #include <zend_hash.h>
+#include <zend_interfaces.h>
 
 #include <stdbool.h>
 
@@ -55,17 +57,34 @@
 #include "completion_queue.h"
 #include "timeval.h"
 #include "channel.h"
+#include "batch.h"
 #include "byte_buffer.h"
+#include "metadata.h"
+#include "operation.h"
 
 zend_class_entry *grpc_ce_call;
 static zend_object_handlers call_ce_handlers;
 
+/* Stops counting the call as active on its channel */
+static void call_finished(wrapped_grpc_call *call) {
+  if (call->active) {
+    Z_WRAPPED_GRPC_CHANNEL_P(&call->channel)->active_calls--;
+    call->active = false;
+  }
+}
+
 /* Frees and destroys an instance of wrapped_grpc_call */
 static void free_wrapped_grpc_call(zend_object *object) {
   wrapped_grpc_call *call = wrapped_grpc_call_from_obj(object);
   if (call->owned && call->wrapped != NULL) {
     grpc_call_destroy(call->wrapped);
   }
+  call->wrapped = NULL;
+  if (call->queue != NULL) {
+    grpc_php_completion_queue_unref(call->queue);
+  }
+  call_finished(call);
+  zval_ptr_dtor(&call->channel);
   zend_object_std_dtor(&call->std);
 }
 
@@ -83,15 +102,17 @@ zend_object *create_wrapped_grpc_call(zend_class_entry *class_type) {
 
 /* Wraps a grpc_call struct in a PHP object. Owned indicates whether the
    struct should be destroyed at the end of the object's lifecycle */
-void grpc_php_wrap_call(grpc_call *wrapped, bool owned, zval *call_object) {
+void grpc_php_wrap_call(grpc_call *wrapped, bool owned,
+                        grpc_php_completion_queue *queue, zval *call_object) {
   object_init_ex(call_object, grpc_ce_call);
   wrapped_grpc_call *call = Z_WRAPPED_GRPC_CALL_P(call_object);
   call->wrapped = wrapped;
   call->owned = owned;
+  call->queue = grpc_php_completion_queue_ref(queue);
 }
 
 /* Creates and returns a PHP array object with the data in a
- * grpc_metadata_array. Returns NULL on failure */
+ * grpc_metadata_array */
 void grpc_parse_metadata_array(grpc_metadata_array *metadata_array,
                                zval *array) {
   int count = metadata_array->count;
@@ -100,46 +121,44 @@ void grpc_parse_metadata_array(grpc_metadata_array *metadata_array,
   zval *data;
   HashTable *array_hash;
   zval inner_array;
-  char *str_key;
-  char *str_val;
-  size_t key_len;
+  grpc_metadata *elem;
 
   array_init(array);
   array_hash = HASH_OF(array);
-  grpc_metadata *elem;
   for (i = 0; i < count; i++) {
     elem = &elements[i];
-    key_len = strlen(elem->key);
-    str_key = ecalloc(key_len + 1, sizeof(char));
-    memcpy(str_key, elem->key, key_len);
-    str_val = ecalloc(elem->value_length + 1, sizeof(char));
-    memcpy(str_val, elem->value, elem->value_length);
-    if ((data = zend_hash_str_find(array_hash, str_key, key_len)) != NULL) {
-      if (Z_TYPE_P(data) != IS_ARRAY) {
-        zend_throw_exception(zend_exception_get_default(),
-                             "Metadata hash somehow contains wrong types.",
-                             1);
-        efree(str_key);
-        efree(str_val);
-        return;
-      }
-      add_next_index_stringl(data, str_val, elem->value_length);
-    } else {
+    if ((data = zend_hash_str_find(array_hash, elem->key,
+                                   strlen(elem->key))) == NULL) {
       array_init(&inner_array);
-      add_next_index_stringl(&inner_array, str_val, elem->value_length);
-      add_assoc_zval(array, str_key, &inner_array);
+      data = zend_hash_str_add_new(array_hash, elem->key, strlen(elem->key),
+                                   &inner_array);
     }
+    add_next_index_stringl(data, elem->value, elem->value_length);
   }
 }
 
-/* Populates a grpc_metadata_array with the data in a PHP array object.
-   Returns true on success and false on failure */
+/* Populates a grpc_metadata_array with the data in a PHP array object or a
+   MetadataTemplate. Returns true on success and false on failure */
 bool create_metadata_array(zval *array, grpc_metadata_array *metadata) {
   zval *inner_array;
   zval *value;
   HashTable *array_hash;
   HashTable *inner_array_hash;
   zend_string *key;
+  wrapped_grpc_metadata_template *template;
+  if (Z_TYPE_P(array) == IS_OBJECT &&
+      instanceof_function(Z_OBJCE_P(array), grpc_ce_metadata_template)) {
+    /* Already validated and laid out, so it only needs copying */
+    template = Z_WRAPPED_GRPC_METADATA_TEMPLATE_P(array);
+    grpc_metadata_array_init(metadata);
+    metadata->capacity = template->count;
+    metadata->count = template->count;
+    metadata->metadata = gpr_malloc(MAX(template->count, 1) *
+                                    sizeof(grpc_metadata));
+    memcpy(metadata->metadata, template->metadata,
+           template->count * sizeof(grpc_metadata));
+    return true;
+  }
   if (Z_TYPE_P(array) != IS_ARRAY) {
     return false;
   }
@@ -192,6 +211,7 @@ PHP_METHOD(Call, __construct) {
   zend_string *method;
   zval *deadline_obj;
   zend_string *host_override = NULL;
+  void *registered_call;
 
   /* "OSO|S" == 1 Object, 1 string, 1 Object, 1 optional string */
   if (zend_parse_parameters(ZEND_NUM_ARGS(), "OSO|S", &channel_obj,
@@ -211,87 +231,187 @@ PHP_METHOD(Call, __construct) {
     return;
   }
   add_property_zval(getThis(), "channel", channel_obj);
+  ZVAL_COPY(&call->channel, channel_obj);
+  channel->active_calls++;
+  call->active = true;
   wrapped_grpc_timeval *deadline = Z_WRAPPED_GRPC_TIMEVAL_P(deadline_obj);
-  call->wrapped =
-    grpc_channel_create_call(channel->wrapped, NULL, GRPC_PROPAGATE_DEFAULTS,
-                             completion_queue, ZSTR_VAL(method),
-                             host_override == NULL ? NULL :
-                             ZSTR_VAL(host_override),
-                             deadline->wrapped, NULL);
+  call->queue = grpc_php_completion_queue_ref(channel->queue);
+  registered_call = grpc_php_channel_registered_call(channel, method,
+                                                     host_override);
+  if (registered_call != NULL) {
+    call->wrapped =
+      grpc_channel_create_registered_call(channel->wrapped, NULL,
+                                          GRPC_PROPAGATE_DEFAULTS,
+                                          call->queue->wrapped,
+                                          registered_call,
+                                          deadline->wrapped, NULL);
+  } else {
+    call->wrapped =
+      grpc_channel_create_call(channel->wrapped, NULL,
+                               GRPC_PROPAGATE_DEFAULTS,
+                               call->queue->wrapped, ZSTR_VAL(method),
+                               host_override == NULL ? NULL :
+                               ZSTR_VAL(host_override),
+                               deadline->wrapped, NULL);
+  }
   call->owned = true;
 }
 
-/**
- * Start a batch of RPC actions.
- * @param array batch Array of actions to take
- * @return object Object with results of all actions
- */
-PHP_METHOD(Call, startBatch) {
-  wrapped_grpc_call *call = Z_WRAPPED_GRPC_CALL_P(getThis());
+/* State of one batch of ops started on a call. The ops point into the
+ * struct itself, so it must stay in place until the batch has completed */
+struct batch {
+  grpc_php_tag tag;
+  /* Kept alive by whoever waits for the batch */
+  wrapped_grpc_call *call;
   grpc_op ops[8];
-  size_t op_num = 0;
-  zval *array;
-  zval *value;
-  zval *inner_value;
-  HashTable *array_hash;
-  HashTable *status_hash;
-  HashTable *message_hash;
-  zval *message_value;
-  zval *message_flags;
-  zend_string *key;
-  zend_ulong index;
-
+  size_t op_num;
   grpc_metadata_array metadata;
   grpc_metadata_array trailing_metadata;
   grpc_metadata_array recv_metadata;
   grpc_metadata_array recv_trailing_metadata;
   grpc_status_code status;
-  char *status_details = NULL;
-  size_t status_details_capacity = 0;
+  char *status_details;
+  size_t status_details_capacity;
   grpc_byte_buffer *message;
+  /* Whether the received message is returned as a ByteBuffer object */
+  bool message_as_byte_buffer;
   int cancelled;
-  grpc_call_error error;
-  char *message_str;
-  size_t message_len;
-  zval recv_status;
+};
 
-  grpc_metadata_array_init(&metadata);
-  grpc_metadata_array_init(&trailing_metadata);
-  grpc_metadata_array_init(&recv_metadata);
-  grpc_metadata_array_init(&recv_trailing_metadata);
-  object_init(return_value);
-  memset(ops, 0, sizeof(ops));
+static void batch_init(struct batch *batch,
+                       grpc_php_completion_queue *queue) {
+  memset(batch, 0, sizeof(struct batch));
+  grpc_php_tag_init(&batch->tag, queue);
+  grpc_metadata_array_init(&batch->metadata);
+  grpc_metadata_array_init(&batch->trailing_metadata);
+  grpc_metadata_array_init(&batch->recv_metadata);
+  grpc_metadata_array_init(&batch->recv_trailing_metadata);
+}
 
-  /* "a" == 1 array */
-  if (zend_parse_parameters(ZEND_NUM_ARGS(), "a", &array) == FAILURE) {
+static void batch_destroy(struct batch *batch) {
+  grpc_metadata_array_destroy(&batch->metadata);
+  grpc_metadata_array_destroy(&batch->trailing_metadata);
+  grpc_metadata_array_destroy(&batch->recv_metadata);
+  grpc_metadata_array_destroy(&batch->recv_trailing_metadata);
+  if (batch->status_details != NULL) {
+    gpr_free(batch->status_details);
+  }
+  for (int i = 0; i < batch->op_num; i++) {
+    if (batch->ops[i].op == GRPC_OP_SEND_MESSAGE) {
+      grpc_byte_buffer_destroy(batch->ops[i].data.send_message);
+    }
+    if (batch->ops[i].op == GRPC_OP_RECV_MESSAGE) {
+      grpc_byte_buffer_destroy(batch->message);
+    }
+  }
+}
+
+/* Reads a message to send from the "stream" or "file" (a path) of a send
+ * message array, limited by its optional "offset" and "length". Throws and
+ * returns false if the source cannot be read */
+static bool batch_parse_message_source(HashTable *message_hash,
+                                       zval *source, grpc_op *op) {
+  php_stream *stream;
+  zval *range_value;
+  zend_long offset = -1;
+  zend_long length = -1;
+
+  if ((range_value = zend_hash_str_find(message_hash, "offset",
+                                        sizeof("offset") - 1)) != NULL) {
+    if (Z_TYPE_P(range_value) != IS_LONG || Z_LVAL_P(range_value) < 0) {
+      zend_throw_exception(spl_ce_InvalidArgumentException,
+                           "Expected a non-negative int for message offset",
+                           1);
+      return false;
+    }
+    offset = Z_LVAL_P(range_value);
+  }
+  if ((range_value = zend_hash_str_find(message_hash, "length",
+                                        sizeof("length") - 1)) != NULL) {
+    if (Z_TYPE_P(range_value) != IS_LONG || Z_LVAL_P(range_value) < 0) {
+      zend_throw_exception(spl_ce_InvalidArgumentException,
+                           "Expected a non-negative int for message length",
+                           1);
+      return false;
+    }
+    length = Z_LVAL_P(range_value);
+  }
+
+  if (Z_TYPE_P(source) == IS_STRING) {
+    if (CHECK_NULL_PATH(Z_STRVAL_P(source), Z_STRLEN_P(source))) {
+      zend_throw_exception(spl_ce_InvalidArgumentException,
+                           "Message file path must not contain null bytes",
+                           1);
+      return false;
+    }
+    stream = php_stream_open_wrapper(Z_STRVAL_P(source), "rb",
+                                     REPORT_ERRORS, NULL);
+    if (stream == NULL) {
+      zend_throw_exception(spl_ce_InvalidArgumentException,
+                           "Could not open the message file", 1);
+      return false;
+    }
+    op->data.send_message =
+      stream_to_byte_buffer(stream, offset < 0 ? 0 : offset, length);
+    php_stream_close(stream);
+  } else {
+    stream = NULL;
+    if (Z_TYPE_P(source) == IS_RESOURCE) {
+      php_stream_from_zval_no_verify(stream, source);
+    }
+    if (stream == NULL) {
+      zend_throw_exception(spl_ce_InvalidArgumentException,
+                           "Expected a stream for send message", 1);
+      return false;
+    }
+    op->data.send_message = stream_to_byte_buffer(stream, offset, length);
+  }
+  if (op->data.send_message == NULL) {
     zend_throw_exception(spl_ce_InvalidArgumentException,
-                         "start_batch expects an array", 1);
-    goto cleanup;
+                         "Could not read the message range", 1);
+    return false;
   }
+  return true;
+}
+
+/* Fills a batch with the ops described by a PHP array. Throws and returns
+ * false if the array is malformed */
+static bool batch_parse(struct batch *batch, zval *array) {
+  grpc_op *op;
+  zval *value;
+  zval *inner_value;
+  HashTable *array_hash;
+  HashTable *status_hash;
+  HashTable *message_hash;
+  zval *message_value;
+  zval *message_flags;
+  zend_string *key;
+  zend_ulong index;
 
   array_hash = HASH_OF(array);
   ZEND_HASH_FOREACH_KEY_VAL(array_hash, index, key, value) {
     if (key) {
       zend_throw_exception(spl_ce_InvalidArgumentException,
                            "batch keys must be integers", 1);
-      goto cleanup;
+      return false;
     }
+    op = &batch->ops[batch->op_num];
 
     switch(index) {
     case GRPC_OP_SEND_INITIAL_METADATA:
-      if (!create_metadata_array(value, &metadata)) {
+      if (!create_metadata_array(value, &batch->metadata)) {
         zend_throw_exception(spl_ce_InvalidArgumentException,
                              "Bad metadata value given", 1);
-        goto cleanup;
+        return false;
       }
-      ops[op_num].data.send_initial_metadata.count = metadata.count;
-      ops[op_num].data.send_initial_metadata.metadata = metadata.metadata;
+      op->data.send_initial_metadata.count = batch->metadata.count;
+      op->data.send_initial_metadata.metadata = batch->metadata.metadata;
       break;
     case GRPC_OP_SEND_MESSAGE:
       if (Z_TYPE_P(value) != IS_ARRAY) {
         zend_throw_exception(spl_ce_InvalidArgumentException,
                              "Expected an array for send message", 1);
-        goto cleanup;
+        return false;
       }
       message_hash = HASH_OF(value);
       if ((message_flags =
@@ -300,17 +420,29 @@ PHP_METHOD(Call, startBatch) {
         if (Z_TYPE_P(message_flags) != IS_LONG) {
           zend_throw_exception(spl_ce_InvalidArgumentException,
                                "Expected an int for message flags", 1);
+          return false;
         }
-        ops[op_num].flags = Z_LVAL_P(message_flags) & GRPC_WRITE_USED_MASK;
+        op->flags = Z_LVAL_P(message_flags) & GRPC_WRITE_USED_MASK;
+      }
+      if ((message_value = zend_hash_str_find(message_hash, "stream",
+                                              sizeof("stream") - 1))
+          != NULL ||
+          (message_value = zend_hash_str_find(message_hash, "file",
+                                              sizeof("file") - 1))
+          != NULL) {
+        if (!batch_parse_message_source(message_hash, message_value, op)) {
+          return false;
+        }
+        break;
       }
       if ((message_value = zend_hash_str_find(message_hash, "message",
                                               sizeof("message") - 1))
           == NULL || Z_TYPE_P(message_value) != IS_STRING) {
         zend_throw_exception(spl_ce_InvalidArgumentException,
                              "Expected a string for send message", 1);
-        goto cleanup;
+        return false;
       }
-      ops[op_num].data.send_message =
+      op->data.send_message =
         string_to_byte_buffer(Z_STRVAL_P(message_value),
                               Z_STRLEN_P(message_value));
       break;
@@ -321,145 +453,716 @@ PHP_METHOD(Call, startBatch) {
       if ((inner_value = zend_hash_str_find(status_hash, "metadata",
                                             sizeof("metadata") - 1))
           != NULL) {
-        if (!create_metadata_array(inner_value, &trailing_metadata)) {
+        if (!create_metadata_array(inner_value, &batch->trailing_metadata)) {
           zend_throw_exception(spl_ce_InvalidArgumentException,
                                "Bad trailing metadata value given", 1);
-          goto cleanup;
+          return false;
         }
-        ops[op_num].data.send_status_from_server.trailing_metadata =
-          trailing_metadata.metadata;
-        ops[op_num].data.send_status_from_server.trailing_metadata_count =
-          trailing_metadata.count;
+        op->data.send_status_from_server.trailing_metadata =
+          batch->trailing_metadata.metadata;
+        op->data.send_status_from_server.trailing_metadata_count =
+          batch->trailing_metadata.count;
       }
       if ((inner_value = zend_hash_str_find(status_hash, "code",
                                             sizeof("code") - 1)) != NULL) {
         if (Z_TYPE_P(inner_value) != IS_LONG) {
           zend_throw_exception(spl_ce_InvalidArgumentException,
                                "Status code must be an integer", 1);
-          goto cleanup;
+          return false;
         }
-        ops[op_num].data.send_status_from_server.status =
-          Z_LVAL_P(inner_value);
+        op->data.send_status_from_server.status = Z_LVAL_P(inner_value);
       } else {
         zend_throw_exception(spl_ce_InvalidArgumentException,
                              "Integer status code is required", 1);
-        goto cleanup;
+        return false;
       }
       if ((inner_value = zend_hash_str_find(status_hash, "details",
                                             sizeof("details") - 1)) != NULL) {
         if (Z_TYPE_P(inner_value) != IS_STRING) {
           zend_throw_exception(spl_ce_InvalidArgumentException,
                                "Status details must be a string", 1);
-          goto cleanup;
+          return false;
         }
-        ops[op_num].data.send_status_from_server.status_details =
+        op->data.send_status_from_server.status_details =
           Z_STRVAL_P(inner_value);
       } else {
         zend_throw_exception(spl_ce_InvalidArgumentException,
                              "String status details is required", 1);
-        goto cleanup;
+        return false;
       }
       break;
     case GRPC_OP_RECV_INITIAL_METADATA:
-      ops[op_num].data.recv_initial_metadata = &recv_metadata;
+      op->data.recv_initial_metadata = &batch->recv_metadata;
       break;
     case GRPC_OP_RECV_MESSAGE:
-      ops[op_num].data.recv_message = &message;
+      if (Z_TYPE_P(value) == IS_ARRAY &&
+          (inner_value = zend_hash_str_find(HASH_OF(value), "byte_buffer",
+                                            sizeof("byte_buffer") - 1))
+          != NULL) {
+        batch->message_as_byte_buffer = zend_is_true(inner_value);
+      }
+      op->data.recv_message = &batch->message;
       break;
     case GRPC_OP_RECV_STATUS_ON_CLIENT:
-      ops[op_num].data.recv_status_on_client.trailing_metadata =
-        &recv_trailing_metadata;
-      ops[op_num].data.recv_status_on_client.status = &status;
-      ops[op_num].data.recv_status_on_client.status_details =
-        &status_details;
-      ops[op_num].data.recv_status_on_client.status_details_capacity =
-        &status_details_capacity;
+      op->data.recv_status_on_client.trailing_metadata =
+        &batch->recv_trailing_metadata;
+      op->data.recv_status_on_client.status = &batch->status;
+      op->data.recv_status_on_client.status_details = &batch->status_details;
+      op->data.recv_status_on_client.status_details_capacity =
+        &batch->status_details_capacity;
       break;
     case GRPC_OP_RECV_CLOSE_ON_SERVER:
-      ops[op_num].data.recv_close_on_server.cancelled = &cancelled;
+      op->data.recv_close_on_server.cancelled = &batch->cancelled;
       break;
     default:
       zend_throw_exception(spl_ce_InvalidArgumentException,
                            "Unrecognized key in batch", 1);
-      goto cleanup;
+      return false;
     }
-    ops[op_num].op = (grpc_op_type)index;
-    ops[op_num].flags = 0;
-    ops[op_num].reserved = NULL;
-    op_num++;
+    op->op = (grpc_op_type)index;
+    op->reserved = NULL;
+    batch->op_num++;
   }
   ZEND_HASH_FOREACH_END();
+  return true;
+}
 
-  error = grpc_call_start_batch(call->wrapped, ops, op_num,
-                                call->wrapped, NULL);
+/* Starts the ops of a batch on a call. Throws and returns false if core
+ * rejects the batch */
+static bool batch_start(struct batch *batch, wrapped_grpc_call *call) {
+  grpc_call_error error;
+  error = grpc_call_start_batch(call->wrapped, batch->ops, batch->op_num,
+                                &batch->tag, NULL);
   if (error != GRPC_CALL_OK) {
     zend_throw_exception(spl_ce_LogicException,
                          "start_batch was called incorrectly",
                          (long)error);
-    goto cleanup;
+    return false;
   }
-  grpc_completion_queue_pluck(completion_queue, call->wrapped,
-                              gpr_inf_future(GPR_CLOCK_REALTIME), NULL);
-  for (int i = 0; i < op_num; i++) {
-    switch(ops[i].op) {
+  return true;
+}
+
+/* Creates a BatchResult object with the results of a completed batch */
+static void batch_results(struct batch *batch, zval *result) {
+  zval value;
+  zval array;
+  zend_string *message;
+  zval call_obj;
+
+  /* Received metadata points into the call, so it keeps the call alive */
+  ZVAL_OBJ(&call_obj, &batch->call->std);
+  grpc_php_batch_result_init(result);
+  for (int i = 0; i < batch->op_num; i++) {
+    switch(batch->ops[i].op) {
     case GRPC_OP_SEND_INITIAL_METADATA:
-      add_property_bool(return_value, "send_metadata", true);
+      ZVAL_TRUE(&value);
+      grpc_php_batch_result_set(result, GRPC_PHP_RESULT_SEND_METADATA,
+                                &value);
       break;
     case GRPC_OP_SEND_MESSAGE:
-      add_property_bool(return_value, "send_message", true);
+      ZVAL_TRUE(&value);
+      grpc_php_batch_result_set(result, GRPC_PHP_RESULT_SEND_MESSAGE,
+                                &value);
       break;
     case GRPC_OP_SEND_CLOSE_FROM_CLIENT:
-      add_property_bool(return_value, "send_close", true);
+      ZVAL_TRUE(&value);
+      grpc_php_batch_result_set(result, GRPC_PHP_RESULT_SEND_CLOSE, &value);
       break;
     case GRPC_OP_SEND_STATUS_FROM_SERVER:
-      add_property_bool(return_value, "send_status", true);
+      ZVAL_TRUE(&value);
+      grpc_php_batch_result_set(result, GRPC_PHP_RESULT_SEND_STATUS, &value);
       break;
     case GRPC_OP_RECV_INITIAL_METADATA:
-      grpc_parse_metadata_array(&recv_metadata, array);
-      add_property_zval(return_value, "metadata", array);
+      grpc_php_wrap_metadata(&batch->recv_metadata, &call_obj, &value);
+      grpc_php_batch_result_set(result, GRPC_PHP_RESULT_METADATA, &value);
       break;
     case GRPC_OP_RECV_MESSAGE:
-      byte_buffer_to_string(message, &message_str, &message_len);
-      if (message_str == NULL) {
-        add_property_null(return_value, "message");
-      } else {
-        add_property_stringl(return_value, "message", message_str,
-                             message_len);
+      if (batch->message_as_byte_buffer && batch->message != NULL) {
+        /* The object takes over the buffer */
+        grpc_php_wrap_byte_buffer(batch->message, &value);
+        batch->message = NULL;
+        grpc_php_batch_result_set(result, GRPC_PHP_RESULT_MESSAGE, &value);
+        break;
+      }
+      message = byte_buffer_to_zend_string(batch->message);
+      if (message != NULL) {
+        /* The property takes over the string without copying it */
+        ZVAL_STR(&value, message);
+        grpc_php_batch_result_set(result, GRPC_PHP_RESULT_MESSAGE, &value);
       }
       break;
     case GRPC_OP_RECV_STATUS_ON_CLIENT:
-      object_init(&recv_status);
-      grpc_parse_metadata_array(&recv_trailing_metadata, array);
-      add_property_zval(&recv_status, "metadata", array);
-      add_property_long(&recv_status, "code", status);
-      add_property_string(&recv_status, "details", status_details);
-      add_property_zval(return_value, "status", &recv_status);
+      call_finished(batch->call);
+      object_init(&value);
+      grpc_php_wrap_metadata(&batch->recv_trailing_metadata, &call_obj,
+                             &array);
+      add_property_zval(&value, "metadata", &array);
+      zval_ptr_dtor(&array);
+      add_property_long(&value, "code", batch->status);
+      add_property_string(&value, "details",
+                          batch->status_details == NULL ? "" :
+                          batch->status_details);
+      grpc_php_batch_result_set(result, GRPC_PHP_RESULT_STATUS, &value);
       break;
     case GRPC_OP_RECV_CLOSE_ON_SERVER:
-      add_property_bool(return_value, "cancelled", cancelled);
+      ZVAL_BOOL(&value, batch->cancelled);
+      grpc_php_batch_result_set(result, GRPC_PHP_RESULT_CANCELLED, &value);
       break;
     default:
       break;
     }
   }
+}
+
+static void batch_operation_finish(grpc_php_tag *tag, zval *result) {
+  batch_results((struct batch *)tag, result);
+}
+
+static void batch_operation_cancel(zval *owner) {
+  wrapped_grpc_call *call = Z_WRAPPED_GRPC_CALL_P(owner);
+  /* At request shutdown the call may have been freed first */
+  if (call->wrapped != NULL) {
+    grpc_call_cancel(call->wrapped, NULL);
+  }
+}
+
+static void batch_operation_destroy(grpc_php_tag *tag) {
+  batch_destroy((struct batch *)tag);
+  efree(tag);
+}
 
- cleanup:
-  grpc_metadata_array_destroy(&metadata);
-  grpc_metadata_array_destroy(&trailing_metadata);
-  grpc_metadata_array_destroy(&recv_metadata);
-  grpc_metadata_array_destroy(&recv_trailing_metadata);
-  if (status_details != NULL) {
-    gpr_free(status_details);
+/* Marks the result of a batch that ran out of wait time. A batch left in
+ * flight gets a result that holds its Operation to wait for again */
+static void batch_operation_timed_out(zval *operation_object, zval *result) {
+  zval timed_out;
+  if (operation_object != NULL) {
+    grpc_php_batch_result_init(result);
+    Z_ADDREF_P(operation_object);
+    grpc_php_batch_result_set(result, GRPC_PHP_RESULT_OPERATION,
+                              operation_object);
   }
-  for (int i = 0; i < op_num; i++) {
-    if (ops[i].op == GRPC_OP_SEND_MESSAGE) {
-      grpc_byte_buffer_destroy(ops[i].data.send_message);
+  if (Z_TYPE_P(result) == IS_OBJECT) {
+    ZVAL_TRUE(&timed_out);
+    grpc_php_batch_result_set(result, GRPC_PHP_RESULT_TIMED_OUT, &timed_out);
+  }
+}
+
+static const grpc_php_operation_ops batch_operation_ops = {
+  batch_operation_finish,
+  batch_operation_cancel,
+  batch_operation_destroy,
+  batch_operation_timed_out
+};
+
+/* Allocates, parses and starts a batch. Returns NULL after throwing if the
+ * batch could not be started */
+static struct batch *batch_create(wrapped_grpc_call *call, zval *array) {
+  struct batch *batch = emalloc(sizeof(struct batch));
+  batch_init(batch, call->queue);
+  batch->call = call;
+  if (!batch_parse(batch, array) || !batch_start(batch, call)) {
+    batch_destroy(batch);
+    efree(batch);
+    return NULL;
+  }
+  return batch;
+}
+
+/* Waits for a started batch and fills result with its results. If the
+ * batch has not completed by the wait deadline, it is cancelled or handed
+ * back as an Operation, depending on grpc.cancel_on_timeout */
+static void batch_wait(struct batch *batch, zval *call_obj,
+                       zval *deadline_obj, zval *result) {
+  zval operation;
+
+  if (grpc_php_await_operation(&batch->tag, &batch_operation_ops,
+                               grpc_php_wait_deadline(deadline_obj),
+                               result)) {
+    return;
+  }
+  if (GRPC_G(cancel_on_timeout)) {
+    batch_operation_cancel(call_obj);
+    grpc_php_await_operation(&batch->tag, &batch_operation_ops,
+                             gpr_inf_future(GPR_CLOCK_REALTIME), result);
+    batch_operation_timed_out(NULL, result);
+  } else {
+    grpc_php_wrap_operation(&batch->tag, &batch_operation_ops, call_obj,
+                            &operation);
+    batch_operation_timed_out(&operation, result);
+    zval_ptr_dtor(&operation);
+  }
+}
+
+/* Adds an op without arguments to a batch */
+static grpc_op *batch_add_op(struct batch *batch, grpc_op_type type) {
+  grpc_op *op = &batch->ops[batch->op_num++];
+  op->op = type;
+  op->flags = 0;
+  op->reserved = NULL;
+  return op;
+}
+
+/* Fills a batch with all the ops of a unary call from the client. Throws
+ * and returns false if the metadata is malformed */
+static bool batch_fill_unary(struct batch *batch, zend_string *message,
+                             zval *metadata, zend_long flags) {
+  grpc_op *op;
+
+  if (!create_metadata_array(metadata, &batch->metadata)) {
+    zend_throw_exception(spl_ce_InvalidArgumentException,
+                         "Bad metadata value given", 1);
+    return false;
+  }
+  op = batch_add_op(batch, GRPC_OP_SEND_INITIAL_METADATA);
+  op->data.send_initial_metadata.count = batch->metadata.count;
+  op->data.send_initial_metadata.metadata = batch->metadata.metadata;
+  op = batch_add_op(batch, GRPC_OP_SEND_MESSAGE);
+  op->flags = flags & GRPC_WRITE_USED_MASK;
+  op->data.send_message = string_to_byte_buffer(ZSTR_VAL(message),
+                                                ZSTR_LEN(message));
+  batch_add_op(batch, GRPC_OP_SEND_CLOSE_FROM_CLIENT);
+  op = batch_add_op(batch, GRPC_OP_RECV_INITIAL_METADATA);
+  op->data.recv_initial_metadata = &batch->recv_metadata;
+  op = batch_add_op(batch, GRPC_OP_RECV_MESSAGE);
+  op->data.recv_message = &batch->message;
+  op = batch_add_op(batch, GRPC_OP_RECV_STATUS_ON_CLIENT);
+  op->data.recv_status_on_client.trailing_metadata =
+    &batch->recv_trailing_metadata;
+  op->data.recv_status_on_client.status = &batch->status;
+  op->data.recv_status_on_client.status_details = &batch->status_details;
+  op->data.recv_status_on_client.status_details_capacity =
+    &batch->status_details_capacity;
+  return true;
+}
+
+/* Fills a batch from a Batch template and the values of one run of it,
+ * in the order of the template's ops. args may be NULL when the template
+ * takes no values. Throws and returns false if the values do not match the
+ * template */
+static bool batch_fill_template(struct batch *batch,
+                                wrapped_grpc_batch *template,
+                                HashTable *args) {
+  HashPosition position;
+  zval *metadata;
+  zval *message;
+  zval *code;
+  zval *details;
+  grpc_op *op;
+
+  if ((args == NULL ? 0 : zend_hash_num_elements(args)) !=
+      template->arg_num) {
+    zend_throw_exception(spl_ce_InvalidArgumentException,
+                         "Wrong number of values for the batch", 1);
+    return false;
+  }
+  if (args != NULL) {
+    zend_hash_internal_pointer_reset_ex(args, &position);
+  }
+#define NEXT_ARG(arg)                                         \
+  do {                                                        \
+    (arg) = zend_hash_get_current_data_ex(args, &position);   \
+    zend_hash_move_forward_ex(args, &position);               \
+  } while (0)
+
+  for (size_t i = 0; i < template->op_num; i++) {
+    op = batch_add_op(batch, template->ops[i].op);
+    op->flags = template->ops[i].flags;
+    switch(template->ops[i].op) {
+    case GRPC_OP_SEND_INITIAL_METADATA:
+      NEXT_ARG(metadata);
+      if (!create_metadata_array(metadata, &batch->metadata)) {
+        zend_throw_exception(spl_ce_InvalidArgumentException,
+                             "Bad metadata value given", 1);
+        return false;
+      }
+      op->data.send_initial_metadata.count = batch->metadata.count;
+      op->data.send_initial_metadata.metadata = batch->metadata.metadata;
+      break;
+    case GRPC_OP_SEND_MESSAGE:
+      NEXT_ARG(message);
+      if (Z_TYPE_P(message) != IS_STRING) {
+        zend_throw_exception(spl_ce_InvalidArgumentException,
+                             "Expected a string for send message", 1);
+        return false;
+      }
+      op->data.send_message = string_to_byte_buffer(Z_STRVAL_P(message),
+                                                    Z_STRLEN_P(message));
+      break;
+    case GRPC_OP_SEND_STATUS_FROM_SERVER:
+      NEXT_ARG(metadata);
+      NEXT_ARG(code);
+      NEXT_ARG(details);
+      if (!create_metadata_array(metadata, &batch->trailing_metadata)) {
+        zend_throw_exception(spl_ce_InvalidArgumentException,
+                             "Bad trailing metadata value given", 1);
+        return false;
+      }
+      if (Z_TYPE_P(code) != IS_LONG) {
+        zend_throw_exception(spl_ce_InvalidArgumentException,
+                             "Status code must be an integer", 1);
+        return false;
+      }
+      if (Z_TYPE_P(details) != IS_STRING) {
+        zend_throw_exception(spl_ce_InvalidArgumentException,
+                             "Status details must be a string", 1);
+        return false;
+      }
+      op->data.send_status_from_server.trailing_metadata =
+        batch->trailing_metadata.metadata;
+      op->data.send_status_from_server.trailing_metadata_count =
+        batch->trailing_metadata.count;
+      op->data.send_status_from_server.status = Z_LVAL_P(code);
+      op->data.send_status_from_server.status_details = Z_STRVAL_P(details);
+      break;
+    case GRPC_OP_RECV_INITIAL_METADATA:
+      op->data.recv_initial_metadata = &batch->recv_metadata;
+      break;
+    case GRPC_OP_RECV_MESSAGE:
+      batch->message_as_byte_buffer = template->ops[i].byte_buffer;
+      op->data.recv_message = &batch->message;
+      break;
+    case GRPC_OP_RECV_STATUS_ON_CLIENT:
+      op->data.recv_status_on_client.trailing_metadata =
+        &batch->recv_trailing_metadata;
+      op->data.recv_status_on_client.status = &batch->status;
+      op->data.recv_status_on_client.status_details =
+        &batch->status_details;
+      op->data.recv_status_on_client.status_details_capacity =
+        &batch->status_details_capacity;
+      break;
+    case GRPC_OP_RECV_CLOSE_ON_SERVER:
+      op->data.recv_close_on_server.cancelled = &batch->cancelled;
+      break;
+    default:
+      break;
+    }
+  }
+#undef NEXT_ARG
+  return true;
+}
+
+/**
+ * Start a batch of RPC actions.
+ *
+ * If the batch has not completed by the wait deadline, the result has a
+ * timed_out property set to true. With grpc.cancel_on_timeout on, the call
+ * is then cancelled and the other properties describe how the batch ended.
+ * Otherwise the batch keeps running and the result only has an operation
+ * property, an Operation to collect the results with later.
+ *
+ * OP_SEND_MESSAGE takes a 'message' string, or a 'stream' resource or
+ * 'file' path with an optional 'offset' and 'length' to send part of it.
+ * Regular files are mapped into memory rather than read into PHP strings,
+ * so they must not be truncated before the message is sent: the process
+ * would get SIGBUS.
+ *
+ * Passing ['byte_buffer' => true] for OP_RECV_MESSAGE returns the message
+ * as a ByteBuffer, which reads it in parts instead of as one string.
+ * @param array batch Array of actions to take
+ * @param Timeval wait_deadline The time to stop waiting at. Defaults to
+ *     grpc.wait_timeout_ms from now, or no limit (optional)
+ * @return object Object with results of all actions
+ */
+PHP_METHOD(Call, startBatch) {
+  wrapped_grpc_call *call = Z_WRAPPED_GRPC_CALL_P(getThis());
+  zval *array;
+  zval *deadline_obj = NULL;
+  struct batch *batch;
+
+  /* "a|O" == 1 array, 1 optional object */
+  if (zend_parse_parameters(ZEND_NUM_ARGS(), "a|O", &array, &deadline_obj,
+                            grpc_ce_timeval) == FAILURE) {
+    zend_throw_exception(spl_ce_InvalidArgumentException,
+                         "start_batch expects an array and an optional "
+                         "Timeval", 1);
+    return;
+  }
+
+  batch = batch_create(call, array);
+  if (batch == NULL) {
+    return;
+  }
+  batch_wait(batch, getThis(), deadline_obj, return_value);
+}
+
+/**
+ * Make a whole unary call from the client in one batch: send the metadata,
+ * the message and the close, and receive the metadata, the response and
+ * the status. Waits like startBatch, including for the wait deadline.
+ * @param string message The serialized request
+ * @param array|MetadataTemplate metadata The metadata to send
+ * @param long flags The write flags for the message (optional)
+ * @param Timeval wait_deadline The time to stop waiting at. Defaults to
+ *     grpc.wait_timeout_ms from now, or no limit (optional)
+ * @return object Object with metadata, message and status properties, as
+ *     startBatch returns them
+ */
+PHP_METHOD(Call, unary) {
+  wrapped_grpc_call *call = Z_WRAPPED_GRPC_CALL_P(getThis());
+  zend_string *message;
+  zval *metadata;
+  zend_long flags = 0;
+  zval *deadline_obj = NULL;
+  struct batch *batch;
+
+  /* "Sz|lO" == 1 string, 1 zval, 1 optional long, 1 optional object */
+  if (zend_parse_parameters(ZEND_NUM_ARGS(), "Sz|lO", &message, &metadata,
+                            &flags, &deadline_obj, grpc_ce_timeval) ==
+      FAILURE) {
+    zend_throw_exception(spl_ce_InvalidArgumentException,
+                         "unary expects a string, the metadata, an "
+                         "optional long and an optional Timeval", 1);
+    return;
+  }
+
+  batch = emalloc(sizeof(struct batch));
+  batch_init(batch, call->queue);
+  batch->call = call;
+  if (!batch_fill_unary(batch, message, metadata, flags) ||
+      !batch_start(batch, call)) {
+    batch_destroy(batch);
+    efree(batch);
+    return;
+  }
+  batch_wait(batch, getThis(), deadline_obj, return_value);
+}
+
+/* Waits for a send started by writeMany. Returns false if the wait timed
+ * out, which ends the writes. A send left in flight because
+ * grpc.cancel_on_timeout is off has its Operation stored in pending */
+static bool batch_wait_write(struct batch *batch, zval *call_obj,
+                             zval *pending) {
+  zval result;
+  zval *operation;
+  bool ok;
+
+  ZVAL_UNDEF(&result);
+  batch_wait(batch, call_obj, NULL, &result);
+  ok = Z_TYPE(result) == IS_OBJECT &&
+    !zend_is_true(OBJ_PROP_NUM(Z_OBJ(result), GRPC_PHP_RESULT_TIMED_OUT));
+  if (!ok && Z_TYPE(result) == IS_OBJECT) {
+    operation = OBJ_PROP_NUM(Z_OBJ(result), GRPC_PHP_RESULT_OPERATION);
+    if (Z_TYPE_P(operation) == IS_OBJECT) {
+      ZVAL_COPY(pending, operation);
     }
-    if (ops[i].op == GRPC_OP_RECV_MESSAGE) {
-      grpc_byte_buffer_destroy(message);
+  }
+  zval_ptr_dtor(&result);
+  return ok;
+}
+
+/* Appends each value of a Traversable to an array */
+static int collect_message(zend_object_iterator *iterator, void *array) {
+  zval *message = iterator->funcs->get_current_data(iterator);
+  ZVAL_DEREF(message);
+  Z_TRY_ADDREF_P(message);
+  add_next_index_zval((zval *)array, message);
+  return ZEND_HASH_APPLY_KEEP;
+}
+
+/**
+ * Send many messages, one after the other, without a round trip through
+ * PHP for each. Core only takes one message at a time, so all but the last
+ * are sent with WRITE_BUFFER_HINT, which lets each send complete as soon
+ * as it is buffered, and the last one flushes them. Each message is
+ * prepared while the one before it is being sent.
+ * @param array|Traversable messages The serialized messages
+ * @param long flags The write flags for every message (optional)
+ * @param Operation &pending Set to the Operation of a send that ran out of
+ *     wait time and was left in flight because grpc.cancel_on_timeout is
+ *     off, null otherwise. Dropping it cancels the call (optional)
+ * @return long The number of messages sent, fewer than given if waiting
+ *     for a send timed out
+ */
+PHP_METHOD(Call, writeMany) {
+  wrapped_grpc_call *call = Z_WRAPPED_GRPC_CALL_P(getThis());
+  zval *source;
+  zval messages;
+  zend_long flags = 0;
+  zval *pending_ref = NULL;
+  zval pending_operation;
+  zval *message;
+  struct batch *batch;
+  struct batch *pending = NULL;
+  grpc_op *op;
+  uint32_t remaining;
+  zend_long sent = 0;
+
+  /* "z|lz" == 1 zval, 1 optional long, 1 optional reference */
+  if (zend_parse_parameters(ZEND_NUM_ARGS(), "z|lz", &source, &flags,
+                            &pending_ref) == FAILURE ||
+      !(Z_TYPE_P(source) == IS_ARRAY ||
+        (Z_TYPE_P(source) == IS_OBJECT &&
+         instanceof_function(Z_OBJCE_P(source), zend_ce_traversable)))) {
+    zend_throw_exception(spl_ce_InvalidArgumentException,
+                         "writeMany expects an array or Traversable, an "
+                         "optional long and an optional reference", 1);
+    return;
+  }
+  if (Z_TYPE_P(source) == IS_ARRAY) {
+    ZVAL_COPY(&messages, source);
+  } else {
+    array_init(&messages);
+    if (spl_iterator_apply(source, collect_message, &messages) == FAILURE) {
+      zval_ptr_dtor(&messages);
+      return;
+    }
+  }
+  ZEND_HASH_FOREACH_VAL(Z_ARRVAL(messages), message) {
+    if (Z_TYPE_P(message) != IS_STRING) {
+      zval_ptr_dtor(&messages);
+      zend_throw_exception(spl_ce_InvalidArgumentException,
+                           "Expected strings for messages", 1);
+      return;
+    }
+  } ZEND_HASH_FOREACH_END();
+
+  ZVAL_NULL(&pending_operation);
+  remaining = zend_hash_num_elements(Z_ARRVAL(messages));
+  ZEND_HASH_FOREACH_VAL(Z_ARRVAL(messages), message) {
+    batch = emalloc(sizeof(struct batch));
+    batch_init(batch, call->queue);
+    batch->call = call;
+    op = batch_add_op(batch, GRPC_OP_SEND_MESSAGE);
+    op->flags = flags & GRPC_WRITE_USED_MASK;
+    if (--remaining > 0) {
+      op->flags |= GRPC_WRITE_BUFFER_HINT;
+    }
+    op->data.send_message = string_to_byte_buffer(Z_STRVAL_P(message),
+                                                  Z_STRLEN_P(message));
+    if (pending != NULL) {
+      if (!batch_wait_write(pending, getThis(), &pending_operation)) {
+        pending = NULL;
+        batch_destroy(batch);
+        efree(batch);
+        break;
+      }
+      sent++;
     }
+    pending = batch;
+    if (!batch_start(batch, call)) {
+      pending = NULL;
+      batch_destroy(batch);
+      efree(batch);
+      zval_ptr_dtor(&messages);
+      return;
+    }
+  } ZEND_HASH_FOREACH_END();
+  zval_ptr_dtor(&messages);
+  if (pending != NULL &&
+      batch_wait_write(pending, getThis(), &pending_operation)) {
+    sent++;
   }
-  RETURN_DESTROY_ZVAL(return_value);
+  if (pending_ref != NULL) {
+    ZVAL_DEREF(pending_ref);
+    zval_ptr_dtor(pending_ref);
+    ZVAL_COPY_VALUE(pending_ref, &pending_operation);
+  } else {
+    zval_ptr_dtor(&pending_operation);
+  }
+  RETURN_LONG(sent);
+}
+
+/**
+ * Run a Batch template on this call. Unlike startBatch, the ops are not
+ * parsed again, and only the values that change between runs are passed.
+ * Waits like startBatch, including for the wait deadline.
+ * @param Batch batch The ops to run
+ * @param array values The values for the ops, in the order of the ops
+ *     (optional)
+ * @param Timeval wait_deadline The time to stop waiting at. Defaults to
+ *     grpc.wait_timeout_ms from now, or no limit (optional)
+ * @return BatchResult The results of all ops
+ */
+PHP_METHOD(Call, runBatch) {
+  wrapped_grpc_call *call = Z_WRAPPED_GRPC_CALL_P(getThis());
+  zval *template_obj;
+  zval *args = NULL;
+  zval *deadline_obj = NULL;
+  struct batch *batch;
+
+  /* "O|aO" == 1 object, 1 optional array, 1 optional object */
+  if (zend_parse_parameters(ZEND_NUM_ARGS(), "O|aO", &template_obj,
+                            grpc_ce_batch, &args, &deadline_obj,
+                            grpc_ce_timeval) == FAILURE) {
+    zend_throw_exception(spl_ce_InvalidArgumentException,
+                         "runBatch expects a Batch, an optional array and "
+                         "an optional Timeval", 1);
+    return;
+  }
+
+  batch = emalloc(sizeof(struct batch));
+  batch_init(batch, call->queue);
+  batch->call = call;
+  if (!batch_fill_template(batch, Z_WRAPPED_GRPC_BATCH_P(template_obj),
+                           args == NULL ? NULL : Z_ARRVAL_P(args)) ||
+      !batch_start(batch, call)) {
+    batch_destroy(batch);
+    efree(batch);
+    return;
+  }
+  batch_wait(batch, getThis(), deadline_obj, return_value);
+}
+
+/**
+ * Start a whole unary call like unary, without waiting for it to complete,
+ * so that several calls can be in flight at once.
+ * @param string message The serialized request
+ * @param array|MetadataTemplate metadata The metadata to send
+ * @param long flags The write flags for the message (optional)
+ * @return Operation Handle whose wait() returns what unary would
+ */
+PHP_METHOD(Call, unaryAsync) {
+  wrapped_grpc_call *call = Z_WRAPPED_GRPC_CALL_P(getThis());
+  zend_string *message;
+  zval *metadata;
+  zend_long flags = 0;
+  struct batch *batch;
+
+  /* "Sz|l" == 1 string, 1 zval, 1 optional long */
+  if (zend_parse_parameters(ZEND_NUM_ARGS(), "Sz|l", &message, &metadata,
+                            &flags) == FAILURE) {
+    zend_throw_exception(spl_ce_InvalidArgumentException,
+                         "unaryAsync expects a string, the metadata and an "
+                         "optional long", 1);
+    return;
+  }
+
+  batch = emalloc(sizeof(struct batch));
+  batch_init(batch, call->queue);
+  batch->call = call;
+  if (!batch_fill_unary(batch, message, metadata, flags) ||
+      !batch_start(batch, call)) {
+    batch_destroy(batch);
+    efree(batch);
+    return;
+  }
+  grpc_php_wrap_operation(&batch->tag, &batch_operation_ops, getThis(),
+                          return_value);
+}
+
+/**
+ * Start a batch of RPC actions without waiting for it to complete.
+ * @param array batch Array of actions to take
+ * @return Operation Handle whose wait() returns the results of all actions
+ */
+PHP_METHOD(Call, startBatchAsync) {
+  wrapped_grpc_call *call = Z_WRAPPED_GRPC_CALL_P(getThis());
+  zval *array;
+  struct batch *batch;
+
+  /* "a" == 1 array */
+  if (zend_parse_parameters(ZEND_NUM_ARGS(), "a", &array) == FAILURE) {
+    zend_throw_exception(spl_ce_InvalidArgumentException,
+                         "startBatchAsync expects an array", 1);
+    return;
+  }
+
+  batch = batch_create(call, array);
+  if (batch == NULL) {
+    return;
+  }
+  grpc_php_wrap_operation(&batch->tag, &batch_operation_ops, getThis(),
+                          return_value);
 }
 
 /**
@@ -481,7 +1184,8 @@ PHP_METHOD(Call, cancel) {
 }
 
 /**
- * Set the CallCredentials for this call.
+ * Set the CallCredentials for this call. Throws while the event notifier
+ * runs, as it would invoke their plugin on its thread.
  * @param CallCredentials creds_obj The CallCredentials object
  * @param int The error code
  */
@@ -495,6 +1199,12 @@ PHP_METHOD(Call, setCredentials) {
                          "setCredentials expects 1 CallCredentials", 1);
     return;
   }
+  if (grpc_php_event_notifier_running()) {
+    zend_throw_exception(spl_ce_LogicException,
+                         "Call credentials cannot be set while the event "
+                         "notifier runs", 1);
+    return;
+  }
 
   wrapped_grpc_call_credentials *creds =
     Z_WRAPPED_GRPC_CALL_CREDS_P(creds_obj);
@@ -505,9 +1215,20 @@ PHP_METHOD(Call, setCredentials) {
   RETURN_LONG(error);
 }
 
+ZEND_BEGIN_ARG_INFO_EX(arginfo_write_many, 0, 0, 1)
+  ZEND_ARG_INFO(0, messages)
+  ZEND_ARG_INFO(0, flags)
+  ZEND_ARG_INFO(1, pending)
+ZEND_END_ARG_INFO()
+
 static zend_function_entry call_methods[] = {
-  PHP_ME(Call, __construct, NULL, ZEND_ACC_PUBLIC | ZEND_ACC_CTOR)
+  PHP_ME(Call, __construct, NULL, ZEND_ACC_PUBLIC)
   PHP_ME(Call, startBatch, NULL, ZEND_ACC_PUBLIC)
+  PHP_ME(Call, startBatchAsync, NULL, ZEND_ACC_PUBLIC)
+  PHP_ME(Call, unary, NULL, ZEND_ACC_PUBLIC)
+  PHP_ME(Call, unaryAsync, NULL, ZEND_ACC_PUBLIC)
+  PHP_ME(Call, runBatch, NULL, ZEND_ACC_PUBLIC)
+  PHP_ME(Call, writeMany, arginfo_write_many, ZEND_ACC_PUBLIC)
   PHP_ME(Call, getPeer, NULL, ZEND_ACC_PUBLIC)
   PHP_ME(Call, cancel, NULL, ZEND_ACC_PUBLIC)
   PHP_ME(Call, setCredentials, NULL, ZEND_ACC_PUBLIC)
@@ -45,6 +45,8 @@
 
 #include <grpc/grpc.h>
 
+#include "completion_queue.h"
+
 /* Class entry for the Call PHP class */
 extern zend_class_entry *grpc_ce_call;
 
@@ -52,6 +54,11 @@ extern zend_class_entry *grpc_ce_call;
 typedef struct wrapped_grpc_call {
   bool owned;
   grpc_call *wrapped;
+  grpc_php_completion_queue *queue;
+  /* The Channel of a client call, undefined for server calls */
+  zval channel;
+  /* Whether the call counts towards the active calls of its Channel */
+  bool active;
   zend_object std;
 } wrapped_grpc_call;
 
@@ -66,16 +73,18 @@ static inline wrapped_grpc_call
 /* Initializes the Call PHP class */
 void grpc_init_call();
 
-/* Creates a Call object that wraps the given grpc_call struct */
-void grpc_php_wrap_call(grpc_call *wrapped, bool owned, zval *call_object);
+/* Creates a Call object that wraps the given grpc_call struct, created on
+ * the given queue */
+void grpc_php_wrap_call(grpc_call *wrapped, bool owned,
+                        grpc_php_completion_queue *queue, zval *call_object);
 
 /* Creates and returns a PHP associative array of metadata from a C array of
  * call metadata */
 void grpc_parse_metadata_array(grpc_metadata_array *metadata_array,
                                zval *array);
 
-/* Populates a grpc_metadata_array with the data in a PHP array object.
-   Returns true on success and false on failure */
+/* Populates a grpc_metadata_array with the data in a PHP array object or a
+   MetadataTemplate. Returns true on success and false on failure */
 bool create_metadata_array(zval *array, grpc_metadata_array *metadata);
 
 #endif /* NET_GRPC_PHP_GRPC_CHANNEL_H_ */
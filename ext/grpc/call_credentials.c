@@ -44,6 +44,7 @@
 #include <ext/spl/spl_exceptions.h>
 #include "php_grpc.h"
 #include "call.h"
+#include "completion_queue.h"
 
 #include <zend_exceptions.h>
 #include <zend_hash.h>
@@ -116,7 +117,9 @@ PHP_METHOD(CallCredentials, createComposite) {
 }
 
 /**
- * Create a call credentials object from the plugin API
+ * Create a call credentials object from the plugin API. The callback runs
+ * on whichever thread polls for the call, so this throws while the event
+ * notifier runs
  * @param function callback The callback function
  * @return CallCredentials The new call credentials object
  */
@@ -124,6 +127,13 @@ PHP_METHOD(CallCredentials, createFromPlugin) {
   zend_fcall_info *fci;
   zend_fcall_info_cache *fci_cache;
 
+  if (grpc_php_event_notifier_running()) {
+    zend_throw_exception(spl_ce_LogicException,
+                         "Plugin credentials cannot be used while the event "
+                         "notifier runs", 1);
+    return;
+  }
+
   fci = (zend_fcall_info *)emalloc(sizeof(zend_fcall_info));
   fci_cache = (zend_fcall_info_cache *)emalloc(sizeof(zend_fcall_info_cache));
   memset(fci, 0, sizeof(zend_fcall_info));
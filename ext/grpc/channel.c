@@ -44,13 +44,16 @@
 #include "php_grpc.h"
 
 #include <zend_exceptions.h>
+#include <zend_smart_str.h>
 
 #include <stdbool.h>
 
 #include <grpc/grpc.h>
 #include <grpc/grpc_security.h>
+#include <grpc/support/sync.h>
 
 #include "completion_queue.h"
+#include "operation.h"
 #include "channel_credentials.h"
 #include "server.h"
 #include "timeval.h"
@@ -58,11 +61,74 @@
 zend_class_entry *grpc_ce_channel;
 static zend_object_handlers channel_ce_handlers;
 
+/* The registry holds one reference to each entry, and every Channel object
+ * using it another. Entries live in persistent memory and, in thread safe
+ * builds, are shared between threads, hence the lock */
+typedef struct grpc_php_persistent_channel {
+  grpc_channel *wrapped;
+  char *key;
+  size_t key_len;
+  size_t refcount;
+  /* Registered call handles by method and host, which stay valid as long
+   * as the channel */
+  HashTable registered_calls;
+} grpc_php_persistent_channel;
+
+static HashTable persistent_channels;
+static gpr_mu persistent_channels_mu;
+
+static void persistent_channel_unref(grpc_php_persistent_channel *entry) {
+  size_t refcount;
+  gpr_mu_lock(&persistent_channels_mu);
+  refcount = --entry->refcount;
+  gpr_mu_unlock(&persistent_channels_mu);
+  if (refcount == 0) {
+    zend_hash_destroy(&entry->registered_calls);
+    grpc_channel_destroy(entry->wrapped);
+    pefree(entry->key, 1);
+    pefree(entry, 1);
+  }
+}
+
+/* Removes the entry from the registry, so that later requests create a new
+ * channel, and drops the reference the registry held */
+static void persistent_channel_forget(grpc_php_persistent_channel *entry) {
+  bool listed = false;
+  gpr_mu_lock(&persistent_channels_mu);
+  if (zend_hash_str_find_ptr(&persistent_channels, entry->key,
+                             entry->key_len) == entry) {
+    zend_hash_str_del(&persistent_channels, entry->key, entry->key_len);
+    listed = true;
+  }
+  gpr_mu_unlock(&persistent_channels_mu);
+  if (listed) {
+    persistent_channel_unref(entry);
+  }
+}
+
+/* Releases the grpc_channel of the object, leaving persistent channels to
+ * the registry */
+static void release_wrapped_grpc_channel(wrapped_grpc_channel *channel) {
+  if (channel->registered_calls != NULL) {
+    zend_hash_destroy(channel->registered_calls);
+    FREE_HASHTABLE(channel->registered_calls);
+    channel->registered_calls = NULL;
+  }
+  if (channel->persistent != NULL) {
+    persistent_channel_unref(channel->persistent);
+    channel->persistent = NULL;
+  } else if (channel->wrapped != NULL) {
+    grpc_channel_destroy(channel->wrapped);
+  }
+  channel->wrapped = NULL;
+}
+
 /* Frees and destroys an instance of wrapped_grpc_channel */
 static void free_wrapped_grpc_channel(zend_object *object) {
   wrapped_grpc_channel *channel = wrapped_grpc_channel_from_obj(object);
-  if (channel->wrapped != NULL) {
-    grpc_channel_destroy(channel->wrapped);
+  release_wrapped_grpc_channel(channel);
+  if (channel->queue != NULL) {
+    grpc_php_completion_queue_unref(channel->queue);
   }
   zend_object_std_dtor(&channel->std);
 }
@@ -79,6 +145,62 @@ zend_object *create_wrapped_grpc_channel(zend_class_entry *class_type) {
   return &intern->std;
 }
 
+zend_string *grpc_php_method_key(zend_string *method, zend_string *host) {
+  size_t host_len = host == NULL ? 0 : ZSTR_LEN(host);
+  zend_string *key = zend_string_alloc(ZSTR_LEN(method) + 1 + host_len, 0);
+  memcpy(ZSTR_VAL(key), ZSTR_VAL(method), ZSTR_LEN(method) + 1);
+  if (host != NULL) {
+    memcpy(ZSTR_VAL(key) + ZSTR_LEN(method) + 1, ZSTR_VAL(host), host_len);
+  }
+  ZSTR_VAL(key)[ZSTR_LEN(key)] = '\0';
+  return key;
+}
+
+/* Finds the handle of a registered call, registering it first if register
+ * is true. Returns NULL if the method is not registered */
+static void *channel_registered_call(wrapped_grpc_channel *channel,
+                                     zend_string *method, zend_string *host,
+                                     bool register_call) {
+  HashTable *registered_calls;
+  zend_string *key;
+  void *handle;
+
+  if (channel->persistent != NULL) {
+    registered_calls = &channel->persistent->registered_calls;
+    gpr_mu_lock(&persistent_channels_mu);
+  } else {
+    if (channel->registered_calls == NULL) {
+      if (!register_call) {
+        return NULL;
+      }
+      ALLOC_HASHTABLE(channel->registered_calls);
+      zend_hash_init(channel->registered_calls, 8, NULL, NULL, 0);
+    }
+    registered_calls = channel->registered_calls;
+  }
+  key = grpc_php_method_key(method, host);
+  handle = zend_hash_str_find_ptr(registered_calls, ZSTR_VAL(key),
+                                  ZSTR_LEN(key));
+  if (handle == NULL && register_call) {
+    handle = grpc_channel_register_call(channel->wrapped, ZSTR_VAL(method),
+                                        host == NULL ? NULL : ZSTR_VAL(host),
+                                        NULL);
+    zend_hash_str_add_ptr(registered_calls, ZSTR_VAL(key), ZSTR_LEN(key),
+                          handle);
+  }
+  zend_string_release(key);
+  if (channel->persistent != NULL) {
+    gpr_mu_unlock(&persistent_channels_mu);
+  }
+  return handle;
+}
+
+void *grpc_php_channel_registered_call(wrapped_grpc_channel *channel,
+                                       zend_string *method,
+                                       zend_string *host) {
+  return channel_registered_call(channel, method, host, false);
+}
+
 void php_grpc_read_args_array(zval *args_array, grpc_channel_args *args) {
   HashTable *array_hash;
   int args_index;
@@ -117,10 +239,100 @@ void php_grpc_read_args_array(zval *args_array, grpc_channel_args *args) {
   } ZEND_HASH_FOREACH_END();
 }
 
+static int compare_args_keys(const void *a, const void *b) {
+  return strcmp(((const grpc_arg *)a)->key, ((const grpc_arg *)b)->key);
+}
+
+/* Builds the registry key of a channel: the target, the credentials
+ * identity and the args sorted by key. Every part is length prefixed so
+ * that different channels cannot end up with the same key */
+static zend_string *persistent_channel_key(
+    zend_string *target, grpc_channel_args *args,
+    wrapped_grpc_channel_credentials *creds) {
+  smart_str key = {0};
+  grpc_arg *sorted;
+  size_t i;
+
+  smart_str_append_unsigned(&key, ZSTR_LEN(target));
+  smart_str_appendc(&key, ':');
+  smart_str_append(&key, target);
+  if (creds == NULL) {
+    smart_str_appends(&key, "|insecure");
+  } else {
+    smart_str_appendc(&key, '|');
+    smart_str_append(&key, creds->hashstr);
+  }
+  sorted = ecalloc(args->num_args + 1, sizeof(grpc_arg));
+  memcpy(sorted, args->args, args->num_args * sizeof(grpc_arg));
+  qsort(sorted, args->num_args, sizeof(grpc_arg), compare_args_keys);
+  for (i = 0; i < args->num_args; i++) {
+    smart_str_appendc(&key, '|');
+    smart_str_append_unsigned(&key, strlen(sorted[i].key));
+    smart_str_appendc(&key, ':');
+    smart_str_appends(&key, sorted[i].key);
+    if (sorted[i].type == GRPC_ARG_INTEGER) {
+      smart_str_appendc(&key, 'i');
+      smart_str_append_long(&key, sorted[i].value.integer);
+    } else {
+      smart_str_appendc(&key, 's');
+      smart_str_append_unsigned(&key, strlen(sorted[i].value.string));
+      smart_str_appendc(&key, ':');
+      smart_str_appends(&key, sorted[i].value.string);
+    }
+  }
+  efree(sorted);
+  smart_str_0(&key);
+  return key.s;
+}
+
+static grpc_channel *create_channel(zend_string *target,
+                                    grpc_channel_args *args,
+                                    wrapped_grpc_channel_credentials *creds) {
+  if (creds == NULL) {
+    return grpc_insecure_channel_create(ZSTR_VAL(target), args, NULL);
+  }
+  return grpc_secure_channel_create(creds->wrapped, ZSTR_VAL(target), args,
+                                    NULL);
+}
+
+/* Returns a reference to the registry entry for the key, creating the
+ * channel if no earlier request did */
+static grpc_php_persistent_channel *persistent_channel_get(
+    zend_string *key, zend_string *target, grpc_channel_args *args,
+    wrapped_grpc_channel_credentials *creds) {
+  grpc_php_persistent_channel *entry;
+  gpr_mu_lock(&persistent_channels_mu);
+  entry = zend_hash_str_find_ptr(&persistent_channels, ZSTR_VAL(key),
+                                 ZSTR_LEN(key));
+  if (entry == NULL) {
+    entry = pemalloc(sizeof(grpc_php_persistent_channel), 1);
+    entry->wrapped = create_channel(target, args, creds);
+    entry->key = pemalloc(ZSTR_LEN(key) + 1, 1);
+    memcpy(entry->key, ZSTR_VAL(key), ZSTR_LEN(key) + 1);
+    entry->key_len = ZSTR_LEN(key);
+    entry->refcount = 1;
+    zend_hash_init(&entry->registered_calls, 8, NULL, NULL, 1);
+    zend_hash_str_add_ptr(&persistent_channels, entry->key, entry->key_len,
+                          entry);
+  }
+  entry->refcount++;
+  gpr_mu_unlock(&persistent_channels_mu);
+  return entry;
+}
+
 /**
  * Construct an instance of the Channel class. If the $args array contains a
  * "credentials" key mapping to a ChannelCredentials object, a secure channel
- * will be created with those credentials.
+ * will be created with those credentials. A "completion_queue" key mapping to
+ * a CompletionQueue object makes the channel and its calls use that queue,
+ * and mapping to true gives the channel a queue of its own. Otherwise they
+ * share the default queue.
+ *
+ * A "persistent" key set to true keeps the underlying channel, and its
+ * connections, for later requests of the same process. Channels with the
+ * same target, args and credentials then share it. Composite credentials
+ * call back into PHP code of the request that made them, so channels using
+ * them are never persistent.
  * @param string $target The hostname to associate with this channel
  * @param array $args The arguments to pass to the Channel (optional)
  */
@@ -132,6 +344,9 @@ PHP_METHOD(Channel, __construct) {
   HashTable *array_hash;
   zval *creds_obj = NULL;
   wrapped_grpc_channel_credentials *creds = NULL;
+  zval *persistent_obj;
+  bool persistent = false;
+  zend_string *key;
 
   /* "Sa" == 1 string, 1 array */
   if (zend_parse_parameters(ZEND_NUM_ARGS(), "Sa", &target, &args_array)
@@ -157,14 +372,24 @@ PHP_METHOD(Channel, __construct) {
       zend_hash_str_del(array_hash, "credentials", sizeof("credentials") - 1);
     }
   }
+  if ((persistent_obj = zend_hash_str_find(array_hash, "persistent",
+                                           sizeof("persistent") - 1))
+      != NULL) {
+    persistent = zend_is_true(persistent_obj);
+    zend_hash_str_del(array_hash, "persistent", sizeof("persistent") - 1);
+  }
+  channel->queue = grpc_php_take_completion_queue_arg(args_array);
+  if (channel->queue == NULL) {
+    return;
+  }
   php_grpc_read_args_array(args_array, &args);
-  if (creds == NULL) {
-    channel->wrapped = grpc_insecure_channel_create(ZSTR_VAL(target),
-                                                    &args, NULL);
+  if (persistent && (creds == NULL || creds->hashstr != NULL)) {
+    key = persistent_channel_key(target, &args, creds);
+    channel->persistent = persistent_channel_get(key, target, &args, creds);
+    channel->wrapped = channel->persistent->wrapped;
+    zend_string_release(key);
   } else {
-    channel->wrapped =
-      grpc_secure_channel_create(creds->wrapped, ZSTR_VAL(target),
-                                 &args, NULL);
+    channel->wrapped = create_channel(target, &args, creds);
   }
   efree(args.args);
 }
@@ -199,8 +424,24 @@ PHP_METHOD(Channel, getConnectivityState) {
                                                     (int)try_to_connect));
 }
 
+static void watch_operation_finish(grpc_php_tag *tag, zval *result) {
+  ZVAL_BOOL(result, tag->success);
+}
+
+static void watch_operation_destroy(grpc_php_tag *tag) {
+  efree(tag);
+}
+
+/* A watch has no cancel: it always completes by its deadline */
+static const grpc_php_operation_ops watch_operation_ops = {
+  watch_operation_finish,
+  NULL,
+  watch_operation_destroy,
+  NULL
+};
+
 /**
- * Watch the connectivity state of the channel until it changed
+ * Watch the connectivity state of the channel until it changed.
  * @param long The previous connectivity state of the channel
  * @param Timeval The deadline this function should wait until
  * @return bool If the connectivity state changes from last_state
@@ -222,32 +463,84 @@ PHP_METHOD(Channel, watchConnectivityState) {
   }
 
   wrapped_grpc_timeval *deadline = Z_WRAPPED_GRPC_TIMEVAL_P(deadline_obj);
+  grpc_php_tag *tag = emalloc(sizeof(grpc_php_tag));
+  grpc_php_tag_init(tag, channel->queue);
   grpc_channel_watch_connectivity_state(channel->wrapped,
                                         (grpc_connectivity_state)last_state,
-                                        deadline->wrapped, completion_queue,
-                                        NULL);
-  grpc_event event =
-    grpc_completion_queue_pluck(completion_queue, NULL,
-                                gpr_inf_future(GPR_CLOCK_REALTIME), NULL);
-  RETURN_BOOL(event.success);
+                                        deadline->wrapped,
+                                        channel->queue->wrapped, tag);
+  /* The watch itself ends by the deadline */
+  grpc_php_await_operation(tag, &watch_operation_ops,
+                           gpr_inf_future(GPR_CLOCK_REALTIME), return_value);
+}
+
+/**
+ * Get the number of calls created on this channel that have not received
+ * their status yet, for spreading calls over several channels
+ * @return long The number of active calls
+ */
+PHP_METHOD(Channel, getActiveCallCount) {
+  wrapped_grpc_channel *channel = Z_WRAPPED_GRPC_CHANNEL_P(getThis());
+  RETURN_LONG(channel->active_calls);
 }
 
 /**
- * Close the channel
+ * Register methods that calls will be made to, so that core prepares their
+ * paths once instead of for every call. Calls to registered methods are
+ * then created through the registration. A persistent channel keeps its
+ * registrations for later requests.
+ * @param array $methods The method names
+ * @param string $host The host override the calls will use (optional)
+ */
+PHP_METHOD(Channel, registerMethods) {
+  wrapped_grpc_channel *channel = Z_WRAPPED_GRPC_CHANNEL_P(getThis());
+  zval *methods;
+  zval *method;
+  zend_string *host = NULL;
+
+  /* "a|S" == 1 array, 1 optional string */
+  if (zend_parse_parameters(ZEND_NUM_ARGS(), "a|S", &methods, &host) ==
+      FAILURE) {
+    zend_throw_exception(spl_ce_InvalidArgumentException,
+                         "registerMethods expects an array and an optional "
+                         "string", 1);
+    return;
+  }
+  if (channel->wrapped == NULL) {
+    zend_throw_exception(spl_ce_InvalidArgumentException,
+                         "Methods cannot be registered on a closed Channel",
+                         1);
+    return;
+  }
+  ZEND_HASH_FOREACH_VAL(Z_ARRVAL_P(methods), method) {
+    if (Z_TYPE_P(method) != IS_STRING) {
+      zend_throw_exception(spl_ce_InvalidArgumentException,
+                           "Method names must be strings", 1);
+      return;
+    }
+    channel_registered_call(channel, Z_STR_P(method), host, true);
+  } ZEND_HASH_FOREACH_END();
+}
+
+/**
+ * Close the channel. A persistent channel is also dropped from the registry,
+ * and destroyed once no other Channel object uses it.
  */
 PHP_METHOD(Channel, close) {
   wrapped_grpc_channel *channel = Z_WRAPPED_GRPC_CHANNEL_P(getThis());
-  if (channel->wrapped != NULL) {
-    grpc_channel_destroy(channel->wrapped);
-    channel->wrapped = NULL;
+  if (channel->persistent != NULL) {
+    persistent_channel_forget(channel->persistent);
   }
+  release_wrapped_grpc_channel(channel);
 }
 
 static zend_function_entry channel_methods[] = {
-  PHP_ME(Channel, __construct, NULL, ZEND_ACC_PUBLIC | ZEND_ACC_CTOR)
+  PHP_ME(Channel, __construct, NULL, ZEND_ACC_PUBLIC)
   PHP_ME(Channel, getTarget, NULL, ZEND_ACC_PUBLIC)
   PHP_ME(Channel, getConnectivityState, NULL, ZEND_ACC_PUBLIC)
   PHP_ME(Channel, watchConnectivityState, NULL, ZEND_ACC_PUBLIC)
+  PHP_ME(Channel, getActiveCallCount, NULL, ZEND_ACC_PUBLIC)
+  PHP_ME(Channel, registerMethods, NULL, ZEND_ACC_PUBLIC)
   PHP_ME(Channel, close, NULL, ZEND_ACC_PUBLIC)
   PHP_FE_END
 };
@@ -262,4 +555,15 @@ void grpc_init_channel() {
   channel_ce_handlers.offset =
     XtOffsetOf(wrapped_grpc_channel, std);
   channel_ce_handlers.free_obj = free_wrapped_grpc_channel;
+  zend_hash_init(&persistent_channels, 8, NULL, NULL, 1);
+  gpr_mu_init(&persistent_channels_mu);
+}
+
+void grpc_shutdown_channel() {
+  grpc_php_persistent_channel *entry;
+  ZEND_HASH_FOREACH_PTR(&persistent_channels, entry) {
+    persistent_channel_unref(entry);
+  } ZEND_HASH_FOREACH_END();
+  zend_hash_destroy(&persistent_channels);
+  gpr_mu_destroy(&persistent_channels_mu);
 }
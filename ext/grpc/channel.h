@@ -45,12 +45,27 @@
 
 #include <grpc/grpc.h>
 
+#include "completion_queue.h"
+
 /* Class entry for the PHP Channel class */
 extern zend_class_entry *grpc_ce_channel;
 
+/* A grpc_channel kept across requests in the persistent channel registry */
+struct grpc_php_persistent_channel;
+
 /* Wrapper struct for grpc_channel that can be associated with a PHP object */
 typedef struct wrapped_grpc_channel {
   grpc_channel *wrapped;
+  grpc_php_completion_queue *queue;
+  /* The registry entry wrapped comes from, NULL if the channel is the
+   * object's own */
+  struct grpc_php_persistent_channel *persistent;
+  /* Client calls created on the channel that have not received their
+   * status yet */
+  size_t active_calls;
+  /* Registered call handles by method and host, for a channel that is the
+   * object's own. Persistent channels keep theirs in the registry entry */
+  HashTable *registered_calls;
   zend_object std;
 } wrapped_grpc_channel;
 
@@ -66,6 +81,19 @@ static inline wrapped_grpc_channel
 /* Initializes the Channel class */
 void grpc_init_channel();
 
+/* Destroys the channels left in the persistent channel registry */
+void grpc_shutdown_channel();
+
+/* Builds the key a method is registered under: the method, a NUL byte and
+ * the host, if any */
+zend_string *grpc_php_method_key(zend_string *method, zend_string *host);
+
+/* Returns the handle of a method registered on the channel with
+ * Channel::registerMethods, or NULL if it was not registered */
+void *grpc_php_channel_registered_call(wrapped_grpc_channel *channel,
+                                       zend_string *method,
+                                       zend_string *host);
+
 /* Iterates through a PHP array and populates args with the contents */
 void php_grpc_read_args_array(zval *args_array, grpc_channel_args *args);
 
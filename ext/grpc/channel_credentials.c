@@ -46,6 +46,7 @@
 
 #include <zend_exceptions.h>
 #include <zend_hash.h>
+#include <ext/standard/sha1.h>
 
 #include <grpc/support/alloc.h>
 #include <grpc/grpc.h>
@@ -71,6 +72,9 @@ static void free_wrapped_grpc_channel_credentials(zend_object *object) {
   if (creds->wrapped != NULL) {
     grpc_channel_credentials_release(creds->wrapped);
   }
+  if (creds->hashstr != NULL) {
+    zend_string_release(creds->hashstr);
+  }
   zend_object_std_dtor(&creds->std);
 }
 
@@ -88,11 +92,44 @@ zend_object *create_wrapped_grpc_channel_credentials(zend_class_entry
 }
 
 void grpc_php_wrap_channel_credentials(grpc_channel_credentials *wrapped,
+                                       zend_string *hashstr,
                                        zval *credentials_object) {
   object_init_ex(credentials_object, grpc_ce_channel_credentials);
   wrapped_grpc_channel_credentials *credentials =
     Z_WRAPPED_GRPC_CHANNEL_CREDS_P(credentials_object);
   credentials->wrapped = wrapped;
+  credentials->hashstr = hashstr;
+}
+
+/* Adds an optional string to a SHA1 context, telling NULL and empty
+ * strings apart */
+static void sha1_update_optional(PHP_SHA1_CTX *context, zend_string *str) {
+  unsigned char length[sizeof(size_t) + 1] = {0};
+  if (str != NULL) {
+    length[0] = 1;
+    memcpy(length + 1, &ZSTR_LEN(str), sizeof(size_t));
+  }
+  PHP_SHA1Update(context, length, sizeof(length));
+  if (str != NULL) {
+    PHP_SHA1Update(context, (unsigned char *)ZSTR_VAL(str), ZSTR_LEN(str));
+  }
+}
+
+/* Returns the hex SHA1 of the strings SSL credentials are made from */
+static zend_string *ssl_credentials_hashstr(zend_string *pem_root_certs,
+                                            zend_string *private_key,
+                                            zend_string *cert_chain) {
+  PHP_SHA1_CTX context;
+  unsigned char digest[20];
+  char hex[41];
+
+  PHP_SHA1Init(&context);
+  sha1_update_optional(&context, pem_root_certs);
+  sha1_update_optional(&context, private_key);
+  sha1_update_optional(&context, cert_chain);
+  PHP_SHA1Final(digest, &context);
+  make_sha1_digest(hex, digest);
+  return strpprintf(0, "ssl:%s", hex);
 }
 
 /**
@@ -121,7 +158,9 @@ PHP_METHOD(ChannelCredentials, setDefaultRootsPem) {
  */
 PHP_METHOD(ChannelCredentials, createDefault) {
   grpc_channel_credentials *creds = grpc_google_default_credentials_create();
-  grpc_php_wrap_channel_credentials(creds, return_value);
+  grpc_php_wrap_channel_credentials(
+      creds, zend_string_init("default", sizeof("default") - 1, 0),
+      return_value);
   RETURN_DESTROY_ZVAL(return_value);
 }
 
@@ -162,7 +201,9 @@ PHP_METHOD(ChannelCredentials, createSsl) {
                                 ZSTR_VAL(pem_root_certs),
                                 pem_key_cert_pair.private_key == NULL ?
                                 NULL : &pem_key_cert_pair, NULL);
-  grpc_php_wrap_channel_credentials(creds, return_value);
+  grpc_php_wrap_channel_credentials(
+      creds, ssl_credentials_hashstr(pem_root_certs, private_key, cert_chain),
+      return_value);
   RETURN_DESTROY_ZVAL(return_value);
 }
 
@@ -192,7 +233,8 @@ PHP_METHOD(ChannelCredentials, createComposite) {
   grpc_channel_credentials *creds =
     grpc_composite_channel_credentials_create(cred1->wrapped,
                                               cred2->wrapped, NULL);
-  grpc_php_wrap_channel_credentials(creds, return_value);
+  /* Call credentials run PHP callbacks of the request that created them */
+  grpc_php_wrap_channel_credentials(creds, NULL, return_value);
   RETURN_DESTROY_ZVAL(return_value);
 }
 
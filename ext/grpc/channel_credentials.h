@@ -53,6 +53,9 @@ extern zend_class_entry *grpc_ce_channel_credentials;
  * with a PHP object */
 typedef struct wrapped_grpc_channel_credentials {
   grpc_channel_credentials *wrapped;
+  /* Identifies what the credentials were created from, the same in every
+   * request, or NULL if they cannot be told apart that way */
+  zend_string *hashstr;
   zend_object std;
 } wrapped_grpc_channel_credentials;
 
@@ -34,19 +34,366 @@
 #include "completion_queue.h"
 
 #include <php.h>
+#include <ext/spl/spl_exceptions.h>
 
-grpc_completion_queue *completion_queue;
+#include <zend_exceptions.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <grpc/support/alloc.h>
+#include <grpc/support/sync.h>
+#include <grpc/support/thd.h>
+#include <grpc/support/time.h>
+
+grpc_php_completion_queue *default_completion_queue;
+
+zend_class_entry *grpc_ce_completion_queue;
+static zend_object_handlers completion_queue_ce_handlers;
+
+/* Once started, the event notifier is the only consumer of its queue: a
+ * background thread takes events off with grpc_completion_queue_next,
+ * records them on their tags and writes a byte to a pipe, so that an event
+ * loop can select on the read end instead of blocking in core. Waits on
+ * that queue then block on the condition variable instead of plucking */
+static struct {
+  grpc_completion_queue *queue;
+  gpr_thd_id thread;
+  gpr_mu mu;
+  gpr_cv cv;
+  /* Number of events recorded by the thread, and the part of it that
+   * grpc_php_completion_queue_next has already reported */
+  uint64_t events;
+  uint64_t reported;
+  int fds[2];
+  /* Alarm that wakes the thread up to exit while the queue stays open. Its
+   * own address is the tag */
+  grpc_alarm *wakeup;
+} notifier;
+
+static void complete_tag(grpc_php_tag *tag, int success) {
+  tag->success = success != 0;
+  gpr_atm_rel_store(&tag->completed, 1);
+}
+
+static void notifier_thread(void *arg) {
+  grpc_completion_queue *queue = (grpc_completion_queue *)arg;
+  grpc_event event;
+  char signal = 1;
+  while (true) {
+    event = grpc_completion_queue_next(queue,
+                                       gpr_inf_future(GPR_CLOCK_REALTIME),
+                                       NULL);
+    if (event.type == GRPC_QUEUE_SHUTDOWN) {
+      break;
+    }
+    if (event.type != GRPC_OP_COMPLETE) {
+      continue;
+    }
+    if (event.tag == &notifier.wakeup) {
+      break;
+    }
+    gpr_mu_lock(&notifier.mu);
+    if (event.tag != NULL) {
+      complete_tag((grpc_php_tag *)event.tag, event.success);
+    }
+    notifier.events++;
+    gpr_cv_broadcast(&notifier.cv);
+    gpr_mu_unlock(&notifier.mu);
+    if (write(notifier.fds[1], &signal, 1) < 0) {
+      /* The pipe is full, so the reader already has a wakeup pending */
+    }
+  }
+}
+
+static bool notifier_owns(grpc_php_completion_queue *queue) {
+  return notifier.queue != NULL && notifier.queue == queue->wrapped;
+}
+
+/* Starts the event notifier on the queue. Returns false on failure */
+static bool notifier_start(grpc_completion_queue *queue) {
+  gpr_thd_options options = gpr_thd_options_default();
+  if (pipe(notifier.fds) != 0) {
+    return false;
+  }
+  fcntl(notifier.fds[0], F_SETFL,
+        fcntl(notifier.fds[0], F_GETFL) | O_NONBLOCK);
+  fcntl(notifier.fds[1], F_SETFL,
+        fcntl(notifier.fds[1], F_GETFL) | O_NONBLOCK);
+  gpr_mu_init(&notifier.mu);
+  gpr_cv_init(&notifier.cv);
+  notifier.events = 0;
+  notifier.reported = 0;
+  notifier.queue = queue;
+  notifier.wakeup = NULL;
+  gpr_thd_options_set_joinable(&options);
+  if (!gpr_thd_new(&notifier.thread, notifier_thread, queue, &options)) {
+    notifier.queue = NULL;
+    gpr_mu_destroy(&notifier.mu);
+    gpr_cv_destroy(&notifier.cv);
+    close(notifier.fds[0]);
+    close(notifier.fds[1]);
+    return false;
+  }
+  return true;
+}
+
+/* Waits for the notifier thread to exit, on seeing the queue shut down or
+ * the wakeup alarm */
+static void notifier_stop() {
+  gpr_thd_join(notifier.thread);
+  if (notifier.wakeup != NULL) {
+    grpc_alarm_destroy(notifier.wakeup);
+    notifier.wakeup = NULL;
+  }
+  notifier.queue = NULL;
+  gpr_mu_destroy(&notifier.mu);
+  gpr_cv_destroy(&notifier.cv);
+  close(notifier.fds[0]);
+  close(notifier.fds[1]);
+}
+
+grpc_php_completion_queue *grpc_php_completion_queue_create() {
+  grpc_php_completion_queue *queue =
+    gpr_malloc(sizeof(grpc_php_completion_queue));
+  queue->wrapped = grpc_completion_queue_create(NULL);
+  queue->refcount = 1;
+  return queue;
+}
+
+grpc_php_completion_queue *grpc_php_completion_queue_ref(
+    grpc_php_completion_queue *queue) {
+  queue->refcount++;
+  return queue;
+}
+
+void grpc_php_completion_queue_unref(grpc_php_completion_queue *queue) {
+  if (--queue->refcount > 0) {
+    return;
+  }
+  grpc_completion_queue_shutdown(queue->wrapped);
+  if (notifier_owns(queue)) {
+    notifier_stop();
+  } else {
+    while (grpc_completion_queue_next(queue->wrapped,
+                                      gpr_inf_future(GPR_CLOCK_REALTIME),
+                                      NULL).type != GRPC_QUEUE_SHUTDOWN);
+  }
+  grpc_completion_queue_destroy(queue->wrapped);
+  gpr_free(queue);
+}
+
+grpc_php_completion_queue *grpc_php_take_completion_queue_arg(
+    zval *args_array) {
+  HashTable *array_hash = HASH_OF(args_array);
+  zval *queue_obj;
+  grpc_php_completion_queue *queue;
+
+  queue_obj = zend_hash_str_find(array_hash, "completion_queue",
+                                 sizeof("completion_queue") - 1);
+  if (queue_obj == NULL) {
+    return grpc_php_completion_queue_ref(default_completion_queue);
+  }
+  if (Z_TYPE_P(queue_obj) == IS_TRUE) {
+    queue = grpc_php_completion_queue_create();
+  } else if (Z_TYPE_P(queue_obj) == IS_OBJECT &&
+             Z_OBJCE_P(queue_obj) == grpc_ce_completion_queue &&
+             Z_WRAPPED_GRPC_COMPLETION_QUEUE_P(queue_obj)->wrapped != NULL) {
+    queue = grpc_php_completion_queue_ref(
+        Z_WRAPPED_GRPC_COMPLETION_QUEUE_P(queue_obj)->wrapped);
+  } else {
+    zend_throw_exception(spl_ce_InvalidArgumentException,
+                         "completion_queue must be a CompletionQueue object "
+                         "or true", 1);
+    return NULL;
+  }
+  zend_hash_str_del(array_hash, "completion_queue",
+                    sizeof("completion_queue") - 1);
+  return queue;
+}
+
+/* Frees and destroys an instance of wrapped_grpc_completion_queue */
+static void free_wrapped_grpc_completion_queue(zend_object *object) {
+  wrapped_grpc_completion_queue *queue =
+    wrapped_grpc_completion_queue_from_obj(object);
+  if (queue->wrapped != NULL) {
+    grpc_php_completion_queue_unref(queue->wrapped);
+  }
+  zend_object_std_dtor(&queue->std);
+}
+
+/* Initializes an instance of wrapped_grpc_completion_queue to be associated
+ * with an object of a class specified by class_type */
+zend_object *create_wrapped_grpc_completion_queue(
+    zend_class_entry *class_type) {
+  wrapped_grpc_completion_queue *intern;
+  intern = ecalloc(1, sizeof(wrapped_grpc_completion_queue) +
+                   zend_object_properties_size(class_type));
+  zend_object_std_init(&intern->std, class_type);
+  object_properties_init(&intern->std, class_type);
+  intern->std.handlers = &completion_queue_ce_handlers;
+  return &intern->std;
+}
+
+/**
+ * Constructs a new completion queue. Passing it as the "completion_queue"
+ * arg of Channels or Servers makes them, and the Calls they create, share
+ * it instead of the default queue, so waiting for one of their operations
+ * only ever looks at events of that group.
+ */
+PHP_METHOD(CompletionQueue, __construct) {
+  wrapped_grpc_completion_queue *queue =
+    Z_WRAPPED_GRPC_COMPLETION_QUEUE_P(getThis());
+  if (zend_parse_parameters_none() == FAILURE) {
+    return;
+  }
+  if (queue->wrapped == NULL) {
+    queue->wrapped = grpc_php_completion_queue_create();
+  }
+}
+
+static zend_function_entry completion_queue_methods[] = {
+  PHP_ME(CompletionQueue, __construct, NULL, ZEND_ACC_PUBLIC)
+  PHP_FE_END
+};
 
 void grpc_php_init_completion_queue() {
-  completion_queue = grpc_completion_queue_create(NULL);
-  return;
+  zend_class_entry ce;
+  default_completion_queue = grpc_php_completion_queue_create();
+  INIT_CLASS_ENTRY(ce, "Grpc\\CompletionQueue", completion_queue_methods);
+  ce.create_object = create_wrapped_grpc_completion_queue;
+  grpc_ce_completion_queue = zend_register_internal_class(&ce);
+  memcpy(&completion_queue_ce_handlers, zend_get_std_object_handlers(),
+         sizeof(zend_object_handlers));
+  completion_queue_ce_handlers.offset =
+    XtOffsetOf(wrapped_grpc_completion_queue, std);
+  completion_queue_ce_handlers.free_obj = free_wrapped_grpc_completion_queue;
+  /* A clone would not be a wrapped_grpc_completion_queue */
+  completion_queue_ce_handlers.clone_obj = NULL;
 }
 
 void grpc_php_shutdown_completion_queue() {
-  grpc_completion_queue_shutdown(completion_queue);
-  while (grpc_completion_queue_next(completion_queue,
-                                    gpr_inf_future(GPR_CLOCK_REALTIME),
-                                    NULL).type != GRPC_QUEUE_SHUTDOWN);
-  grpc_completion_queue_destroy(completion_queue);
-  return;
+  grpc_php_completion_queue_unref(default_completion_queue);
+  default_completion_queue = NULL;
+}
+
+bool grpc_php_event_notifier_running() {
+  return notifier.queue != NULL;
+}
+
+void grpc_php_tag_init(grpc_php_tag *tag, grpc_php_completion_queue *queue) {
+  gpr_atm_no_barrier_store(&tag->completed, 0);
+  tag->success = false;
+  tag->queue = queue;
+}
+
+bool grpc_php_completion_queue_pluck(grpc_php_tag *tag,
+                                     gpr_timespec deadline) {
+  grpc_event event;
+  if (grpc_php_tag_is_completed(tag)) {
+    return true;
+  }
+  if (notifier_owns(tag->queue)) {
+    deadline = gpr_convert_clock_type(deadline, GPR_CLOCK_REALTIME);
+    gpr_mu_lock(&notifier.mu);
+    while (!grpc_php_tag_is_completed(tag) &&
+           !gpr_cv_wait(&notifier.cv, &notifier.mu, deadline));
+    gpr_mu_unlock(&notifier.mu);
+  } else {
+    event = grpc_completion_queue_pluck(tag->queue->wrapped, tag, deadline,
+                                        NULL);
+    if (event.type == GRPC_OP_COMPLETE) {
+      complete_tag(tag, event.success);
+    }
+  }
+  return grpc_php_tag_is_completed(tag);
+}
+
+bool grpc_php_completion_queue_next(grpc_php_completion_queue *queue,
+                                    gpr_timespec deadline) {
+  grpc_event event;
+  bool got_event;
+  if (notifier_owns(queue)) {
+    deadline = gpr_convert_clock_type(deadline, GPR_CLOCK_REALTIME);
+    gpr_mu_lock(&notifier.mu);
+    while (notifier.events == notifier.reported &&
+           !gpr_cv_wait(&notifier.cv, &notifier.mu, deadline));
+    got_event = notifier.events != notifier.reported;
+    notifier.reported = notifier.events;
+    gpr_mu_unlock(&notifier.mu);
+    return got_event;
+  }
+  event = grpc_completion_queue_next(queue->wrapped, deadline, NULL);
+  if (event.type != GRPC_OP_COMPLETE) {
+    return false;
+  }
+  if (event.tag != NULL) {
+    complete_tag((grpc_php_tag *)event.tag, event.success);
+  }
+  return true;
+}
+
+void grpc_php_completion_queue_flush(grpc_php_completion_queue *queue) {
+  char buffer[64];
+  if (notifier_owns(queue)) {
+    while (read(notifier.fds[0], buffer, sizeof(buffer)) > 0);
+  } else {
+    while (grpc_php_completion_queue_next(queue,
+                                          gpr_inf_past(GPR_CLOCK_REALTIME)));
+  }
+}
+
+/**
+ * Start delivering events of the default completion queue from a background
+ * thread and return a stream that becomes readable whenever one arrives.
+ * The notifier stays on until Grpc\stopEventNotifier(), blocking calls keep
+ * working and Grpc\drain() collects the finished operations. Call
+ * credentials plugins would be invoked on the notifier thread, so creating
+ * or setting call credentials throws while it runs. Queues created with
+ * CompletionQueue are not covered by the notifier.
+ * @return resource A readable stream, never to be read from directly
+ */
+PHP_FUNCTION(getEventNotifier) {
+  php_stream *stream;
+  int fd;
+
+  if (zend_parse_parameters_none() == FAILURE) {
+    return;
+  }
+  if (!notifier_owns(default_completion_queue) &&
+      !notifier_start(default_completion_queue->wrapped)) {
+    zend_throw_exception(spl_ce_RuntimeException,
+                         "Failed to start the event notifier", 1);
+    return;
+  }
+  /* Every stream gets its own descriptor, as PHP closes it with the
+   * stream while the notifier outlives the request */
+  fd = dup(notifier.fds[0]);
+  if (fd < 0 || (stream = php_stream_fopen_from_fd(fd, "rb", NULL)) == NULL) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    zend_throw_exception(spl_ce_RuntimeException,
+                         "Failed to open the event notifier stream", 1);
+    return;
+  }
+  php_stream_to_zval(stream, return_value);
+}
+
+/**
+ * Stop the event notifier, if it is running, so that waits take events off
+ * the default completion queue themselves again. Streams returned by
+ * Grpc\getEventNotifier() stay at end of file from then on.
+ */
+PHP_FUNCTION(stopEventNotifier) {
+  if (zend_parse_parameters_none() == FAILURE) {
+    return;
+  }
+  if (!notifier_owns(default_completion_queue)) {
+    return;
+  }
+  notifier.wakeup =
+    grpc_alarm_create(default_completion_queue->wrapped,
+                      gpr_inf_past(GPR_CLOCK_REALTIME), &notifier.wakeup);
+  notifier_stop();
 }
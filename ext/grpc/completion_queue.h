@@ -36,15 +36,106 @@
 
 #include <php.h>
 
+#include <stdbool.h>
+
 #include <grpc/grpc.h>
+#include <grpc/support/atm.h>
+
+/* A completion queue and the number of references to it. Channels, Servers
+ * and Calls hold one on the queue they start operations on, as do in-flight
+ * Operations and the CompletionQueue object that created it, so the queue
+ * outlives every tag that can still arrive on it whatever order PHP frees
+ * those objects in */
+typedef struct grpc_php_completion_queue {
+  grpc_completion_queue *wrapped;
+  size_t refcount;
+} grpc_php_completion_queue;
+
+/* The queue for operations of objects that were not given one */
+extern grpc_php_completion_queue *default_completion_queue;
+
+/* Wrapper struct for a completion queue that can be associated with a PHP
+ * object */
+typedef struct wrapped_grpc_completion_queue {
+  grpc_php_completion_queue *wrapped;
+  zend_object std;
+} wrapped_grpc_completion_queue;
+
+static inline wrapped_grpc_completion_queue
+*wrapped_grpc_completion_queue_from_obj(zend_object *obj) {
+  return (wrapped_grpc_completion_queue*)(
+      (char*)(obj) - XtOffsetOf(wrapped_grpc_completion_queue, std));
+}
+
+#define Z_WRAPPED_GRPC_COMPLETION_QUEUE_P(zv)           \
+  wrapped_grpc_completion_queue_from_obj(Z_OBJ_P((zv)))
+
+/* Class entry for the CompletionQueue PHP class */
+extern zend_class_entry *grpc_ce_completion_queue;
+
+/* Creates a queue with a single reference */
+grpc_php_completion_queue *grpc_php_completion_queue_create();
+
+/* Takes another reference to the queue and returns it */
+grpc_php_completion_queue *grpc_php_completion_queue_ref(
+    grpc_php_completion_queue *queue);
+
+/* Drops a reference, destroying the queue with the last one */
+void grpc_php_completion_queue_unref(grpc_php_completion_queue *queue);
 
-/* The global completion queue for all operations */
-extern grpc_completion_queue *completion_queue;
+/* Removes the "completion_queue" key from the args array of a Channel or
+ * Server and returns a reference to the queue it selects: the queue of a
+ * CompletionQueue object, a new queue for true, and the default queue if the
+ * key is absent. Throws and returns NULL on any other value */
+grpc_php_completion_queue *grpc_php_take_completion_queue_arg(
+    zval *args_array);
 
-/* Initializes the completion queue */
+/* Tag handed to core for an operation started by the extension. Remembers
+ * the queue its event arrives on and the outcome, so that can still be
+ * inspected after the event was dequeued. completed is atomic because the
+ * event notifier thread may set it */
+typedef struct grpc_php_tag {
+  gpr_atm completed;
+  bool success;
+  grpc_php_completion_queue *queue;
+} grpc_php_tag;
+
+/* Resets a tag before the operation it identifies is started on the queue */
+void grpc_php_tag_init(grpc_php_tag *tag, grpc_php_completion_queue *queue);
+
+/* Returns whether the event for the tag has been dequeued */
+static inline bool grpc_php_tag_is_completed(grpc_php_tag *tag) {
+  return gpr_atm_acq_load(&tag->completed) != 0;
+}
+
+/* Waits until the operation identified by tag completes or the deadline
+ * passes. Returns true if the operation has completed */
+bool grpc_php_completion_queue_pluck(grpc_php_tag *tag,
+                                     gpr_timespec deadline);
+
+/* Takes the next event off the queue and records its outcome on its tag.
+ * Returns false if no event arrived before the deadline */
+bool grpc_php_completion_queue_next(grpc_php_completion_queue *queue,
+                                    gpr_timespec deadline);
+
+/* Records every event that is already waiting on the queue, without
+ * blocking, and resets the event notifier if it is running on it */
+void grpc_php_completion_queue_flush(grpc_php_completion_queue *queue);
+
+/* Initializes the default completion queue and the CompletionQueue PHP
+ * class */
 void grpc_php_init_completion_queue();
 
-/* Shut down the completion queue */
+/* Shut down the default completion queue */
 void grpc_php_shutdown_completion_queue();
 
+/* Returns whether the event notifier thread is running */
+bool grpc_php_event_notifier_running();
+
+/* Returns a stream that becomes readable when events arrive */
+PHP_FUNCTION(getEventNotifier);
+
+/* Stops the event notifier thread */
+PHP_FUNCTION(stopEventNotifier);
+
 #endif /* GRPC_PHP_GRPC_COMPLETION_QUEUE_H_ */
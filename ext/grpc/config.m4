@@ -74,9 +74,9 @@ if test "$PHP_GRPC" != "no"; then
 
   PHP_SUBST(GRPC_SHARED_LIBADD)
 
-  PHP_NEW_EXTENSION(grpc, byte_buffer.c call.c call_credentials.c channel.c \
-    channel_credentials.c completion_queue.c timeval.c server.c \
-    server_credentials.c php_grpc.c, $ext_shared, , -Wall -Werror -Wno-uninitialized -std=c11)
+  PHP_NEW_EXTENSION(grpc, batch.c byte_buffer.c call.c call_credentials.c \
+    channel.c channel_credentials.c completion_queue.c metadata.c operation.c \
+    timeval.c server.c server_credentials.c php_grpc.c, $ext_shared, , -Wall -Werror -Wno-uninitialized -std=c11)
 fi
 
 if test "$PHP_COVERAGE" = "yes"; then
@@ -0,0 +1,454 @@
+/*
+ *
+ * Copyright 2015, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "metadata.h"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <php.h>
+#include <php_ini.h>
+#include <ext/standard/info.h>
+#include <ext/spl/spl_array.h>
+#include <ext/spl/spl_exceptions.h>
+#include <ext/spl/spl_iterators.h>
+#include "php_grpc.h"
+
+#include <zend_exceptions.h>
+#include <zend_interfaces.h>
+
+#include <stdbool.h>
+#include <string.h>
+
+#include <grpc/grpc.h>
+#include <grpc/support/alloc.h>
+
+#include "call.h"
+
+zend_class_entry *grpc_ce_metadata;
+zend_class_entry *grpc_ce_metadata_template;
+static zend_object_handlers metadata_ce_handlers;
+static zend_object_handlers metadata_template_ce_handlers;
+
+/* Frees and destroys an instance of wrapped_grpc_metadata */
+static void free_wrapped_grpc_metadata(zend_object *object) {
+  wrapped_grpc_metadata *metadata = wrapped_grpc_metadata_from_obj(object);
+  grpc_metadata_array_destroy(&metadata->wrapped);
+  zval_ptr_dtor(&metadata->array);
+  zval_ptr_dtor(&metadata->owner);
+  zend_object_std_dtor(&metadata->std);
+}
+
+/* Initializes an instance of wrapped_grpc_metadata to be associated with an
+ * object of a class specified by class_type */
+zend_object *create_wrapped_grpc_metadata(zend_class_entry *class_type) {
+  wrapped_grpc_metadata *intern;
+  intern = ecalloc(1, sizeof(wrapped_grpc_metadata) +
+                   zend_object_properties_size(class_type));
+  zend_object_std_init(&intern->std, class_type);
+  object_properties_init(&intern->std, class_type);
+  intern->std.handlers = &metadata_ce_handlers;
+  grpc_metadata_array_init(&intern->wrapped);
+  ZVAL_UNDEF(&intern->owner);
+  ZVAL_UNDEF(&intern->array);
+  return &intern->std;
+}
+
+void grpc_php_wrap_metadata(grpc_metadata_array *metadata_array,
+                            zval *owner, zval *metadata_object) {
+  wrapped_grpc_metadata *metadata;
+  object_init_ex(metadata_object, grpc_ce_metadata);
+  metadata = Z_WRAPPED_GRPC_METADATA_P(metadata_object);
+  memcpy(&metadata->wrapped, metadata_array, sizeof(grpc_metadata_array));
+  grpc_metadata_array_init(metadata_array);
+  ZVAL_COPY(&metadata->owner, owner);
+}
+
+/* Returns the whole metadata as a PHP array, converting it the first time */
+static zval *metadata_array(wrapped_grpc_metadata *metadata) {
+  if (Z_TYPE(metadata->array) == IS_UNDEF) {
+    grpc_parse_metadata_array(&metadata->wrapped, &metadata->array);
+  }
+  return &metadata->array;
+}
+
+/* Finds the values of one key, without converting the other keys. Returns
+ * false if the key was not received */
+static bool metadata_find(wrapped_grpc_metadata *metadata, zend_string *key,
+                          zval *values) {
+  grpc_metadata *elem;
+  zval *found;
+  bool any = false;
+  size_t i;
+
+  if (Z_TYPE(metadata->array) != IS_UNDEF) {
+    found = zend_hash_find(Z_ARRVAL(metadata->array), key);
+    if (found != NULL && values != NULL) {
+      ZVAL_COPY(values, found);
+    }
+    return found != NULL;
+  }
+  for (i = 0; i < metadata->wrapped.count; i++) {
+    elem = &metadata->wrapped.metadata[i];
+    if (strlen(elem->key) != ZSTR_LEN(key) ||
+        memcmp(elem->key, ZSTR_VAL(key), ZSTR_LEN(key)) != 0) {
+      continue;
+    }
+    if (values == NULL) {
+      return true;
+    }
+    if (!any) {
+      array_init(values);
+    }
+    add_next_index_stringl(values, elem->value, elem->value_length);
+    any = true;
+  }
+  return any;
+}
+
+/**
+ * Whether a key was received
+ * @param string $key The metadata key
+ * @return bool True if the key has values
+ */
+PHP_METHOD(Metadata, offsetExists) {
+  wrapped_grpc_metadata *metadata = Z_WRAPPED_GRPC_METADATA_P(getThis());
+  zend_string *key;
+
+  /* "S" == 1 string */
+  if (zend_parse_parameters(ZEND_NUM_ARGS(), "S", &key) == FAILURE) {
+    zend_throw_exception(spl_ce_InvalidArgumentException,
+                         "offsetExists expects a string", 1);
+    return;
+  }
+  RETURN_BOOL(metadata_find(metadata, key, NULL));
+}
+
+/**
+ * Get the values received for a key
+ * @param string $key The metadata key
+ * @return array The values of the key, or null if it was not received
+ */
+PHP_METHOD(Metadata, offsetGet) {
+  wrapped_grpc_metadata *metadata = Z_WRAPPED_GRPC_METADATA_P(getThis());
+  zend_string *key;
+
+  /* "S" == 1 string */
+  if (zend_parse_parameters(ZEND_NUM_ARGS(), "S", &key) == FAILURE) {
+    zend_throw_exception(spl_ce_InvalidArgumentException,
+                         "offsetGet expects a string", 1);
+    return;
+  }
+  if (!metadata_find(metadata, key, return_value)) {
+    RETURN_NULL();
+  }
+}
+
+/**
+ * Received metadata cannot be changed
+ */
+PHP_METHOD(Metadata, offsetSet) {
+  zend_throw_exception(spl_ce_LogicException,
+                       "Received metadata is read only", 1);
+}
+
+/**
+ * Received metadata cannot be changed
+ */
+PHP_METHOD(Metadata, offsetUnset) {
+  zend_throw_exception(spl_ce_LogicException,
+                       "Received metadata is read only", 1);
+}
+
+/**
+ * Get the number of distinct keys received
+ * @return long The number of keys
+ */
+PHP_METHOD(Metadata, count) {
+  wrapped_grpc_metadata *metadata = Z_WRAPPED_GRPC_METADATA_P(getThis());
+  if (metadata->wrapped.count == 0) {
+    RETURN_LONG(0);
+  }
+  RETURN_LONG(zend_hash_num_elements(Z_ARRVAL_P(metadata_array(metadata))));
+}
+
+/**
+ * Get the whole metadata as an array, as startBatch used to return it
+ * @return array Map of each key to the list of its values
+ */
+PHP_METHOD(Metadata, toArray) {
+  wrapped_grpc_metadata *metadata = Z_WRAPPED_GRPC_METADATA_P(getThis());
+  RETURN_ZVAL(metadata_array(metadata), 1, 0);
+}
+
+/**
+ * Iterate over the keys and their lists of values
+ * @return ArrayIterator An iterator over the whole metadata
+ */
+PHP_METHOD(Metadata, getIterator) {
+  wrapped_grpc_metadata *metadata = Z_WRAPPED_GRPC_METADATA_P(getThis());
+  object_init_ex(return_value, spl_ce_ArrayIterator);
+#if PHP_VERSION_ID >= 80000
+  zend_call_known_instance_method_with_1_params(
+      spl_ce_ArrayIterator->constructor, Z_OBJ_P(return_value), NULL,
+      metadata_array(metadata));
+#else
+  zend_call_method_with_1_params(return_value, spl_ce_ArrayIterator,
+                                 &spl_ce_ArrayIterator->constructor,
+                                 "__construct", NULL,
+                                 metadata_array(metadata));
+#endif
+}
+
+static zend_function_entry metadata_methods[] = {
+  PHP_ME(Metadata, offsetExists, NULL, ZEND_ACC_PUBLIC)
+  PHP_ME(Metadata, offsetGet, NULL, ZEND_ACC_PUBLIC)
+  PHP_ME(Metadata, offsetSet, NULL, ZEND_ACC_PUBLIC)
+  PHP_ME(Metadata, offsetUnset, NULL, ZEND_ACC_PUBLIC)
+  PHP_ME(Metadata, count, NULL, ZEND_ACC_PUBLIC)
+  PHP_ME(Metadata, toArray, NULL, ZEND_ACC_PUBLIC)
+  PHP_ME(Metadata, getIterator, NULL, ZEND_ACC_PUBLIC)
+  PHP_FE_END
+};
+
+/* Frees and destroys an instance of wrapped_grpc_metadata_template */
+static void free_wrapped_grpc_metadata_template(zend_object *object) {
+  wrapped_grpc_metadata_template *template =
+    wrapped_grpc_metadata_template_from_obj(object);
+  if (template->metadata != NULL) {
+    gpr_free(template->metadata);
+  }
+  zval_ptr_dtor(&template->array);
+  zend_object_std_dtor(&template->std);
+}
+
+/* Initializes an instance of wrapped_grpc_metadata_template to be associated
+ * with an object of a class specified by class_type */
+zend_object *create_wrapped_grpc_metadata_template(
+    zend_class_entry *class_type) {
+  wrapped_grpc_metadata_template *intern;
+  intern = ecalloc(1, sizeof(wrapped_grpc_metadata_template) +
+                   zend_object_properties_size(class_type));
+  zend_object_std_init(&intern->std, class_type);
+  object_properties_init(&intern->std, class_type);
+  intern->std.handlers = &metadata_template_ce_handlers;
+  array_init(&intern->array);
+  return &intern->std;
+}
+
+/* Whether a metadata key is nonempty and only has alphanumeric characters,
+ * hyphens and underscores */
+static bool metadata_key_is_valid(zend_string *key) {
+  size_t i;
+  char c;
+  if (ZSTR_LEN(key) == 0) {
+    return false;
+  }
+  for (i = 0; i < ZSTR_LEN(key); i++) {
+    c = ZSTR_VAL(key)[i];
+    if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+          (c >= '0' && c <= '9') || c == '-' || c == '_')) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Validates a PHP metadata array and adds it to a normalized array,
+ * replacing the values of keys it already has. Throws and returns false if
+ * the array is malformed */
+static bool metadata_template_add(zval *array, zval *metadata) {
+  zend_string *key;
+  zend_string *lower_key;
+  zval *values;
+  zval *value;
+
+  ZEND_HASH_FOREACH_STR_KEY_VAL(Z_ARRVAL_P(metadata), key, values) {
+    if (key == NULL || !metadata_key_is_valid(key)) {
+      zend_throw_exception(spl_ce_InvalidArgumentException,
+                           "Metadata keys must be nonempty strings "
+                           "containing only alphanumeric characters, "
+                           "hyphens and underscores", 1);
+      return false;
+    }
+    if (Z_TYPE_P(values) != IS_ARRAY) {
+      zend_throw_exception(spl_ce_InvalidArgumentException,
+                           "Metadata values must be arrays of strings", 1);
+      return false;
+    }
+    ZEND_HASH_FOREACH_VAL(Z_ARRVAL_P(values), value) {
+      if (Z_TYPE_P(value) != IS_STRING) {
+        zend_throw_exception(spl_ce_InvalidArgumentException,
+                             "Metadata values must be arrays of strings",
+                             1);
+        return false;
+      }
+    } ZEND_HASH_FOREACH_END();
+    lower_key = zend_string_tolower(key);
+    Z_TRY_ADDREF_P(values);
+    zend_hash_update(Z_ARRVAL_P(array), lower_key, values);
+    zend_string_release(lower_key);
+  } ZEND_HASH_FOREACH_END();
+  return true;
+}
+
+/* Lays the normalized array of a template out as a metadata vector */
+static void metadata_template_build(wrapped_grpc_metadata_template *template) {
+  zend_string *key;
+  zval *values;
+  zval *value;
+  size_t capacity = 0;
+
+  ZEND_HASH_FOREACH_VAL(Z_ARRVAL(template->array), values) {
+    capacity += zend_hash_num_elements(Z_ARRVAL_P(values));
+  } ZEND_HASH_FOREACH_END();
+  if (template->metadata != NULL) {
+    gpr_free(template->metadata);
+  }
+  template->metadata = gpr_malloc(MAX(capacity, 1) * sizeof(grpc_metadata));
+  memset(template->metadata, 0, MAX(capacity, 1) * sizeof(grpc_metadata));
+  template->count = 0;
+  ZEND_HASH_FOREACH_STR_KEY_VAL(Z_ARRVAL(template->array), key, values) {
+    ZEND_HASH_FOREACH_VAL(Z_ARRVAL_P(values), value) {
+      template->metadata[template->count].key = ZSTR_VAL(key);
+      template->metadata[template->count].value = Z_STRVAL_P(value);
+      template->metadata[template->count].value_length = Z_STRLEN_P(value);
+      template->count++;
+    } ZEND_HASH_FOREACH_END();
+  } ZEND_HASH_FOREACH_END();
+}
+
+/**
+ * Constructs metadata to send on many calls. Keys are checked and
+ * lowercased once here, instead of on every call.
+ * @param array $metadata Map of each key to the list of its values
+ */
+PHP_METHOD(MetadataTemplate, __construct) {
+  wrapped_grpc_metadata_template *template =
+    Z_WRAPPED_GRPC_METADATA_TEMPLATE_P(getThis());
+  zval *metadata;
+  zval array;
+
+  /* "a" == 1 array */
+  if (zend_parse_parameters(ZEND_NUM_ARGS(), "a", &metadata) == FAILURE) {
+    zend_throw_exception(spl_ce_InvalidArgumentException,
+                         "MetadataTemplate expects an array", 1);
+    return;
+  }
+  /* Built aside, so that a malformed array leaves the template as it was */
+  array_init(&array);
+  if (!metadata_template_add(&array, metadata)) {
+    zval_ptr_dtor(&array);
+    return;
+  }
+  zval_ptr_dtor(&template->array);
+  ZVAL_COPY_VALUE(&template->array, &array);
+  metadata_template_build(template);
+}
+
+/**
+ * Get a copy of this template with some keys added or replaced, for the
+ * values that change from call to call
+ * @param array $metadata Map of each key to the list of its values
+ * @return MetadataTemplate The combined metadata
+ */
+PHP_METHOD(MetadataTemplate, with) {
+  wrapped_grpc_metadata_template *template =
+    Z_WRAPPED_GRPC_METADATA_TEMPLATE_P(getThis());
+  wrapped_grpc_metadata_template *combined;
+  zval *metadata;
+  zval array;
+
+  /* "a" == 1 array */
+  if (zend_parse_parameters(ZEND_NUM_ARGS(), "a", &metadata) == FAILURE) {
+    zend_throw_exception(spl_ce_InvalidArgumentException,
+                         "with expects an array", 1);
+    return;
+  }
+  ZVAL_ARR(&array, zend_array_dup(Z_ARRVAL(template->array)));
+  if (!metadata_template_add(&array, metadata)) {
+    zval_ptr_dtor(&array);
+    return;
+  }
+  object_init_ex(return_value, grpc_ce_metadata_template);
+  combined = Z_WRAPPED_GRPC_METADATA_TEMPLATE_P(return_value);
+  zval_ptr_dtor(&combined->array);
+  ZVAL_COPY_VALUE(&combined->array, &array);
+  metadata_template_build(combined);
+}
+
+/**
+ * Get the metadata as an array
+ * @return array Map of each lowercased key to the list of its values
+ */
+PHP_METHOD(MetadataTemplate, toArray) {
+  wrapped_grpc_metadata_template *template =
+    Z_WRAPPED_GRPC_METADATA_TEMPLATE_P(getThis());
+  RETURN_ZVAL(&template->array, 1, 0);
+}
+
+static zend_function_entry metadata_template_methods[] = {
+  PHP_ME(MetadataTemplate, __construct, NULL, ZEND_ACC_PUBLIC)
+  PHP_ME(MetadataTemplate, with, NULL, ZEND_ACC_PUBLIC)
+  PHP_ME(MetadataTemplate, toArray, NULL, ZEND_ACC_PUBLIC)
+  PHP_FE_END
+};
+
+void grpc_init_metadata() {
+  zend_class_entry ce;
+  INIT_CLASS_ENTRY(ce, "Grpc\\Metadata", metadata_methods);
+  ce.create_object = create_wrapped_grpc_metadata;
+  ce.ce_flags |= ZEND_ACC_FINAL;
+  grpc_ce_metadata = zend_register_internal_class(&ce);
+  zend_class_implements(grpc_ce_metadata, 3, zend_ce_arrayaccess,
+                        zend_ce_aggregate, spl_ce_Countable);
+  memcpy(&metadata_ce_handlers, zend_get_std_object_handlers(),
+         sizeof(zend_object_handlers));
+  metadata_ce_handlers.offset = XtOffsetOf(wrapped_grpc_metadata, std);
+  metadata_ce_handlers.free_obj = free_wrapped_grpc_metadata;
+  /* A clone would not be a wrapped_grpc_metadata */
+  metadata_ce_handlers.clone_obj = NULL;
+
+  INIT_CLASS_ENTRY(ce, "Grpc\\MetadataTemplate", metadata_template_methods);
+  ce.create_object = create_wrapped_grpc_metadata_template;
+  grpc_ce_metadata_template = zend_register_internal_class(&ce);
+  memcpy(&metadata_template_ce_handlers, zend_get_std_object_handlers(),
+         sizeof(zend_object_handlers));
+  metadata_template_ce_handlers.offset =
+    XtOffsetOf(wrapped_grpc_metadata_template, std);
+  metadata_template_ce_handlers.free_obj =
+    free_wrapped_grpc_metadata_template;
+  /* A clone would not be a wrapped_grpc_metadata_template */
+  metadata_template_ce_handlers.clone_obj = NULL;
+}
@@ -0,0 +1,103 @@
+/*
+ *
+ * Copyright 2015, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef NET_GRPC_PHP_GRPC_METADATA_H_
+#define NET_GRPC_PHP_GRPC_METADATA_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <php.h>
+#include <php_ini.h>
+#include <ext/standard/info.h>
+#include "php_grpc.h"
+
+#include <grpc/grpc.h>
+
+/* Class entry for the Metadata PHP class */
+extern zend_class_entry *grpc_ce_metadata;
+
+/* Wrapper struct for received metadata that can be associated with a PHP
+ * object. Keys and values are only copied into PHP strings when read */
+typedef struct wrapped_grpc_metadata {
+  grpc_metadata_array wrapped;
+  /* The Call whose grpc_call owns the keys and values of the array */
+  zval owner;
+  /* The whole metadata as a PHP array, once something needed it */
+  zval array;
+  zend_object std;
+} wrapped_grpc_metadata;
+
+static inline wrapped_grpc_metadata
+*wrapped_grpc_metadata_from_obj(zend_object *obj) {
+  return (wrapped_grpc_metadata*)((char*)(obj) -
+                                  XtOffsetOf(wrapped_grpc_metadata, std));
+}
+
+#define Z_WRAPPED_GRPC_METADATA_P(zv)            \
+  wrapped_grpc_metadata_from_obj(Z_OBJ_P((zv)))
+
+/* Class entry for the MetadataTemplate PHP class */
+extern zend_class_entry *grpc_ce_metadata_template;
+
+/* Wrapper struct for metadata to send that has already been validated and
+ * laid out for core, so that it can be sent on many calls as it is */
+typedef struct wrapped_grpc_metadata_template {
+  /* Lowercased keys mapped to their lists of values */
+  zval array;
+  /* Points into the keys and values of array */
+  grpc_metadata *metadata;
+  size_t count;
+  zend_object std;
+} wrapped_grpc_metadata_template;
+
+static inline wrapped_grpc_metadata_template
+*wrapped_grpc_metadata_template_from_obj(zend_object *obj) {
+  return (wrapped_grpc_metadata_template*)(
+      (char*)(obj) - XtOffsetOf(wrapped_grpc_metadata_template, std));
+}
+
+#define Z_WRAPPED_GRPC_METADATA_TEMPLATE_P(zv)            \
+  wrapped_grpc_metadata_template_from_obj(Z_OBJ_P((zv)))
+
+/* Initializes the Metadata and MetadataTemplate PHP classes */
+void grpc_init_metadata();
+
+/* Creates a Metadata object for a received metadata array, taking over its
+ * contents and leaving it empty. The owner is the Call the metadata was
+ * received on, which is kept alive as long as the object */
+void grpc_php_wrap_metadata(grpc_metadata_array *metadata_array,
+                            zval *owner, zval *metadata_object);
+
+#endif /* NET_GRPC_PHP_GRPC_METADATA_H_ */
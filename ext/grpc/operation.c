@@ -0,0 +1,496 @@
+/*
+ *
+ * Copyright 2015, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "operation.h"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <php.h>
+#include <php_ini.h>
+#include <ext/standard/info.h>
+#include <ext/spl/spl_exceptions.h>
+#include "php_grpc.h"
+
+#include <zend_exceptions.h>
+
+#include <stdbool.h>
+
+#include <grpc/grpc.h>
+#include <grpc/support/time.h>
+
+#include "completion_queue.h"
+#include "timeval.h"
+
+zend_class_entry *grpc_ce_operation;
+static zend_object_handlers operation_ce_handlers;
+
+/* Operations in the order they were started, until their completion has
+ * been collected */
+static wrapped_grpc_operation *first_operation = NULL;
+static wrapped_grpc_operation *last_operation = NULL;
+
+static void link_grpc_operation(wrapped_grpc_operation *operation) {
+  operation->prev = last_operation;
+  operation->next = NULL;
+  if (last_operation != NULL) {
+    last_operation->next = operation;
+  } else {
+    first_operation = operation;
+  }
+  last_operation = operation;
+  operation->listed = true;
+}
+
+static void unlink_grpc_operation(wrapped_grpc_operation *operation) {
+  if (!operation->listed) {
+    return;
+  }
+  if (operation->prev != NULL) {
+    operation->prev->next = operation->next;
+  } else {
+    first_operation = operation->next;
+  }
+  if (operation->next != NULL) {
+    operation->next->prev = operation->prev;
+  } else {
+    last_operation = operation->prev;
+  }
+  operation->listed = false;
+}
+
+/* Releases the tag of an operation. Core may still write to the tag until
+ * the operation completes, so an unfinished operation is cancelled and
+ * waited for first */
+static void release_grpc_operation_tag(wrapped_grpc_operation *operation) {
+  grpc_php_completion_queue *queue;
+  if (operation->tag == NULL) {
+    return;
+  }
+  if (!grpc_php_tag_is_completed(operation->tag)) {
+    if (operation->ops->cancel != NULL) {
+      operation->ops->cancel(&operation->owner);
+    }
+    grpc_php_completion_queue_pluck(operation->tag,
+                                    gpr_inf_future(GPR_CLOCK_REALTIME));
+  }
+  queue = operation->tag->queue;
+  operation->ops->destroy(operation->tag);
+  operation->tag = NULL;
+  grpc_php_completion_queue_unref(queue);
+}
+
+/* Frees and destroys an instance of wrapped_grpc_operation */
+static void free_wrapped_grpc_operation(zend_object *object) {
+  wrapped_grpc_operation *operation = wrapped_grpc_operation_from_obj(object);
+  unlink_grpc_operation(operation);
+  release_grpc_operation_tag(operation);
+  zval_ptr_dtor(&operation->result);
+  zval_ptr_dtor(&operation->owner);
+  zend_object_std_dtor(&operation->std);
+}
+
+/* Initializes an instance of wrapped_grpc_operation to be associated with an
+ * object of a class specified by class_type */
+zend_object *create_wrapped_grpc_operation(zend_class_entry *class_type) {
+  wrapped_grpc_operation *intern;
+  intern = ecalloc(1, sizeof(wrapped_grpc_operation) +
+                   zend_object_properties_size(class_type));
+  zend_object_std_init(&intern->std, class_type);
+  object_properties_init(&intern->std, class_type);
+  intern->std.handlers = &operation_ce_handlers;
+  return &intern->std;
+}
+
+/* Wraps an already started operation in a PHP object. The owner is kept
+   alive for as long as the operation may still be referenced by core */
+void grpc_php_wrap_operation(grpc_php_tag *tag,
+                             const grpc_php_operation_ops *ops,
+                             zval *owner, zval *operation_object) {
+  object_init_ex(operation_object, grpc_ce_operation);
+  wrapped_grpc_operation *operation =
+    Z_WRAPPED_GRPC_OPERATION_P(operation_object);
+  operation->tag = tag;
+  operation->ops = ops;
+  grpc_php_completion_queue_ref(tag->queue);
+  ZVAL_COPY(&operation->owner, owner);
+  link_grpc_operation(operation);
+}
+
+/* Waits for the operation and builds its result, if not done already */
+static void wait_grpc_operation(wrapped_grpc_operation *operation) {
+  if (operation->tag == NULL) {
+    return;
+  }
+  grpc_php_completion_queue_pluck(operation->tag,
+                                  gpr_inf_future(GPR_CLOCK_REALTIME));
+  operation->ops->finish(operation->tag, &operation->result);
+  release_grpc_operation_tag(operation);
+  unlink_grpc_operation(operation);
+}
+
+/* Waits until the deadline for an Operation and builds its result.
+ * Returns false if the deadline passes first */
+static bool await_wrapped_operation(zval *operation_object,
+                                    gpr_timespec deadline) {
+  wrapped_grpc_operation *operation =
+    Z_WRAPPED_GRPC_OPERATION_P(operation_object);
+  if (operation->tag != NULL &&
+      !grpc_php_completion_queue_pluck(operation->tag, deadline)) {
+    return false;
+  }
+  wait_grpc_operation(operation);
+  return true;
+}
+
+/* Waits for an operation that has already been started with the given tag
+ * and stores its result. The tag is released before returning true. If the
+ * deadline passes first, false is returned and the still pending tag is
+ * left to the caller */
+bool grpc_php_await_operation(grpc_php_tag *tag,
+                              const grpc_php_operation_ops *ops,
+                              gpr_timespec deadline, zval *result) {
+  if (!grpc_php_completion_queue_pluck(tag, deadline)) {
+    return false;
+  }
+  ops->finish(tag, result);
+  ops->destroy(tag);
+  return true;
+}
+
+/**
+ * Operations are only created by the extension, for operations it started
+ */
+PHP_METHOD(Operation, __construct) {
+}
+
+/**
+ * Check whether the operation has completed. Never blocks.
+ * @return bool True if the operation has completed
+ */
+PHP_METHOD(Operation, isDone) {
+  wrapped_grpc_operation *operation = Z_WRAPPED_GRPC_OPERATION_P(getThis());
+  if (operation->tag == NULL) {
+    RETURN_TRUE;
+  }
+  RETURN_BOOL(grpc_php_completion_queue_pluck(
+      operation->tag, gpr_inf_past(GPR_CLOCK_REALTIME)));
+}
+
+/**
+ * Wait for the operation to complete and return its result. The result is
+ * the same object the blocking version of the operation returns, and the
+ * wait is bounded the same way: when the wait deadline passes, the
+ * operation is cancelled if grpc.cancel_on_timeout is on, and otherwise
+ * left in flight to wait for again.
+ * @param Timeval $wait_deadline The time to stop waiting at. Defaults to
+ *     grpc.wait_timeout_ms from now, or no limit (optional)
+ * @return object The result of the operation, marked as timed out if the
+ *     wait ran out of time
+ */
+PHP_METHOD(Operation, wait) {
+  wrapped_grpc_operation *operation = Z_WRAPPED_GRPC_OPERATION_P(getThis());
+  zval *deadline_obj = NULL;
+
+  /* "|O" == 1 optional object */
+  if (zend_parse_parameters(ZEND_NUM_ARGS(), "|O", &deadline_obj,
+                            grpc_ce_timeval) == FAILURE) {
+    zend_throw_exception(spl_ce_InvalidArgumentException,
+                         "wait expects an optional Timeval", 1);
+    return;
+  }
+  if (await_wrapped_operation(getThis(),
+                              grpc_php_wait_deadline(deadline_obj))) {
+    RETURN_ZVAL(&operation->result, true /* Copy original */,
+                false /* Don't destroy original */);
+  }
+  if (operation->ops->timed_out == NULL) {
+    RETURN_NULL();
+  }
+  if (GRPC_G(cancel_on_timeout) && operation->ops->cancel != NULL) {
+    operation->ops->cancel(&operation->owner);
+    await_wrapped_operation(getThis(), gpr_inf_future(GPR_CLOCK_REALTIME));
+    ZVAL_COPY(return_value, &operation->result);
+    operation->ops->timed_out(NULL, return_value);
+  } else {
+    operation->ops->timed_out(getThis(), return_value);
+  }
+}
+
+/* Collects the operations of a PHP array into a C array owned by the caller.
+ * Throws and returns NULL if the array holds anything but Operations */
+static wrapped_grpc_operation **parse_operations_array(zval *array,
+                                                       const char *func,
+                                                       size_t *count) {
+  wrapped_grpc_operation **operations;
+  HashTable *array_hash = Z_ARRVAL_P(array);
+  zval *value;
+  size_t i = 0;
+
+  operations = ecalloc(zend_hash_num_elements(array_hash) + 1,
+                       sizeof(wrapped_grpc_operation *));
+  ZEND_HASH_FOREACH_VAL(array_hash, value) {
+    if (Z_TYPE_P(value) != IS_OBJECT ||
+        Z_OBJCE_P(value) != grpc_ce_operation) {
+      zend_throw_exception_ex(spl_ce_InvalidArgumentException, 1,
+                              "%s expects an array of Operations", func);
+      efree(operations);
+      return NULL;
+    }
+    operations[i++] = Z_WRAPPED_GRPC_OPERATION_P(value);
+  } ZEND_HASH_FOREACH_END();
+  *count = i;
+  return operations;
+}
+
+/* Reads an optional Timeval deadline argument as an absolute time, so that
+ * a relative Timeval does not restart every time the queue is polled */
+static gpr_timespec parse_wait_deadline(zval *deadline_obj) {
+  if (deadline_obj == NULL) {
+    return gpr_inf_future(GPR_CLOCK_REALTIME);
+  }
+  wrapped_grpc_timeval *deadline = Z_WRAPPED_GRPC_TIMEVAL_P(deadline_obj);
+  return gpr_convert_clock_type(deadline->wrapped, GPR_CLOCK_REALTIME);
+}
+
+gpr_timespec grpc_php_wait_deadline(zval *deadline_obj) {
+  if (deadline_obj != NULL || GRPC_G(wait_timeout_ms) <= 0) {
+    return parse_wait_deadline(deadline_obj);
+  }
+  return gpr_time_add(gpr_now(GPR_CLOCK_REALTIME),
+                      gpr_time_from_millis(GRPC_G(wait_timeout_ms),
+                                           GPR_TIMESPAN));
+}
+
+static bool grpc_operation_is_done(wrapped_grpc_operation *operation) {
+  return operation->tag == NULL || grpc_php_tag_is_completed(operation->tag);
+}
+
+/* Takes the next event off the queues of the pending operations. Core can
+ * only block on one queue at a time, so when they span several queues the
+ * first one is waited on for a short slice and the others are polled, in
+ * turn, until an event arrives or the deadline passes */
+static bool next_operations_event(wrapped_grpc_operation **operations,
+                                  size_t count, gpr_timespec deadline) {
+  grpc_php_completion_queue *queue = NULL;
+  bool shared = true;
+  gpr_timespec slice = gpr_time_from_millis(1, GPR_TIMESPAN);
+  gpr_timespec now;
+  size_t i;
+
+  for (i = 0; i < count; i++) {
+    if (grpc_operation_is_done(operations[i])) {
+      continue;
+    }
+    if (queue == NULL) {
+      queue = operations[i]->tag->queue;
+    } else if (operations[i]->tag->queue != queue) {
+      shared = false;
+    }
+  }
+  if (queue == NULL) {
+    return false;
+  }
+  if (shared) {
+    return grpc_php_completion_queue_next(queue, deadline);
+  }
+  do {
+    now = gpr_now(GPR_CLOCK_REALTIME);
+    if (grpc_php_completion_queue_next(
+            queue, gpr_time_min(deadline, gpr_time_add(now, slice)))) {
+      return true;
+    }
+    for (i = 0; i < count; i++) {
+      if (!grpc_operation_is_done(operations[i]) &&
+          operations[i]->tag->queue != queue &&
+          grpc_php_completion_queue_next(operations[i]->tag->queue,
+                                         gpr_inf_past(GPR_CLOCK_REALTIME))) {
+        return true;
+      }
+    }
+  } while (gpr_time_cmp(gpr_now(GPR_CLOCK_REALTIME), deadline) < 0);
+  return false;
+}
+
+/**
+ * Wait until at least one of the given operations has completed. Events are
+ * taken off the completion queues of the operations as they arrive, so the
+ * results of operations that complete in the meantime are kept for their
+ * wait() calls.
+ * @param array $operations The Operations to wait for
+ * @param Timeval $deadline The time to give up waiting at. Defaults to
+ *     grpc.wait_timeout_ms from now, or no limit (optional)
+ * @return array The keys of the completed operations, empty on timeout
+ */
+PHP_FUNCTION(waitAny) {
+  zval *array;
+  zval *deadline_obj = NULL;
+  wrapped_grpc_operation **operations;
+  size_t count;
+  gpr_timespec deadline;
+  zend_string *key;
+  zend_ulong index;
+  size_t i;
+
+  /* "a|O" == 1 array, 1 optional object */
+  if (zend_parse_parameters(ZEND_NUM_ARGS(), "a|O", &array, &deadline_obj,
+                            grpc_ce_timeval) == FAILURE) {
+    zend_throw_exception(spl_ce_InvalidArgumentException,
+                         "waitAny expects an array and an optional Timeval",
+                         1);
+    return;
+  }
+  operations = parse_operations_array(array, "waitAny", &count);
+  if (operations == NULL) {
+    return;
+  }
+  deadline = grpc_php_wait_deadline(deadline_obj);
+
+  array_init(return_value);
+  do {
+    i = 0;
+    ZEND_HASH_FOREACH_KEY(Z_ARRVAL_P(array), index, key) {
+      if (grpc_operation_is_done(operations[i++])) {
+        if (key != NULL) {
+          add_next_index_str(return_value, zend_string_copy(key));
+        } else {
+          add_next_index_long(return_value, index);
+        }
+      }
+    } ZEND_HASH_FOREACH_END();
+  } while (count > 0 && zend_hash_num_elements(Z_ARRVAL_P(return_value)) == 0
+           && next_operations_event(operations, count, deadline));
+  efree(operations);
+}
+
+/**
+ * Wait until all of the given operations have completed.
+ * @param array $operations The Operations to wait for
+ * @param Timeval $deadline The time to give up waiting at. Defaults to
+ *     grpc.wait_timeout_ms from now, or no limit (optional)
+ * @return bool True if all operations completed before the deadline
+ */
+PHP_FUNCTION(waitAll) {
+  zval *array;
+  zval *deadline_obj = NULL;
+  wrapped_grpc_operation **operations;
+  size_t count;
+  gpr_timespec deadline;
+  size_t pending = 0;
+
+  /* "a|O" == 1 array, 1 optional object */
+  if (zend_parse_parameters(ZEND_NUM_ARGS(), "a|O", &array, &deadline_obj,
+                            grpc_ce_timeval) == FAILURE) {
+    zend_throw_exception(spl_ce_InvalidArgumentException,
+                         "waitAll expects an array and an optional Timeval",
+                         1);
+    return;
+  }
+  operations = parse_operations_array(array, "waitAll", &count);
+  if (operations == NULL) {
+    return;
+  }
+  deadline = grpc_php_wait_deadline(deadline_obj);
+
+  /* Operations never go back to pending, so everything before the first
+   * pending operation can be skipped on the next pass */
+  while (true) {
+    while (pending < count && grpc_operation_is_done(operations[pending])) {
+      pending++;
+    }
+    if (pending == count ||
+        !next_operations_event(operations + pending, count - pending,
+                               deadline)) {
+      break;
+    }
+  }
+  efree(operations);
+  RETURN_BOOL(pending == count);
+}
+
+/**
+ * Collect the operations that have completed since they were started,
+ * without blocking. Each operation is returned once, unless its result has
+ * already been collected with wait(). This also empties the stream returned
+ * by Grpc\getEventNotifier(), so it only becomes readable again once more
+ * events arrive.
+ * @return array The completed Operations, in the order they were started
+ */
+PHP_FUNCTION(drain) {
+  wrapped_grpc_operation *operation;
+  wrapped_grpc_operation *next;
+  zval operation_object;
+
+  if (zend_parse_parameters_none() == FAILURE) {
+    return;
+  }
+  grpc_php_completion_queue_flush(default_completion_queue);
+  for (operation = first_operation; operation != NULL;
+       operation = operation->next) {
+    if (operation->tag != NULL &&
+        operation->tag->queue != default_completion_queue) {
+      grpc_php_completion_queue_flush(operation->tag->queue);
+    }
+  }
+  array_init(return_value);
+  for (operation = first_operation; operation != NULL; operation = next) {
+    next = operation->next;
+    if (grpc_operation_is_done(operation)) {
+      unlink_grpc_operation(operation);
+      ZVAL_OBJ(&operation_object, &operation->std);
+      Z_ADDREF(operation_object);
+      add_next_index_zval(return_value, &operation_object);
+    }
+  }
+}
+
+static zend_function_entry operation_methods[] = {
+  PHP_ME(Operation, __construct, NULL, ZEND_ACC_PRIVATE)
+  PHP_ME(Operation, isDone, NULL, ZEND_ACC_PUBLIC)
+  PHP_ME(Operation, wait, NULL, ZEND_ACC_PUBLIC)
+  PHP_FE_END
+};
+
+void grpc_init_operation() {
+  zend_class_entry ce;
+  INIT_CLASS_ENTRY(ce, "Grpc\\Operation", operation_methods);
+  ce.create_object = create_wrapped_grpc_operation;
+  grpc_ce_operation = zend_register_internal_class(&ce);
+  memcpy(&operation_ce_handlers, zend_get_std_object_handlers(),
+         sizeof(zend_object_handlers));
+  operation_ce_handlers.offset = XtOffsetOf(wrapped_grpc_operation, std);
+  operation_ce_handlers.free_obj = free_wrapped_grpc_operation;
+  /* A clone would not be a wrapped_grpc_operation */
+  operation_ce_handlers.clone_obj = NULL;
+}
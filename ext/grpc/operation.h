@@ -0,0 +1,122 @@
+/*
+ *
+ * Copyright 2015, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef NET_GRPC_PHP_GRPC_OPERATION_H_
+#define NET_GRPC_PHP_GRPC_OPERATION_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <php.h>
+#include <php_ini.h>
+#include <ext/standard/info.h>
+#include "php_grpc.h"
+
+#include <grpc/grpc.h>
+
+#include "completion_queue.h"
+
+/* Class entry for the Operation PHP class */
+extern zend_class_entry *grpc_ce_operation;
+
+/* Callbacks that give meaning to the tag of a started operation */
+typedef struct grpc_php_operation_ops {
+  /* Builds the PHP result of the completed operation */
+  void (*finish)(grpc_php_tag *tag, zval *result);
+  /* Aborts the operation so that waiting for it returns promptly */
+  void (*cancel)(zval *owner);
+  /* Releases the tag and everything it references */
+  void (*destroy)(grpc_php_tag *tag);
+  /* Marks the result of a wait that ran out of time: that of the cancelled
+   * operation, or null with operation_object the Operation if it was left
+   * in flight. Optional; without it Operation::wait never cancels and
+   * returns null when it runs out of time */
+  void (*timed_out)(zval *operation_object, zval *result);
+} grpc_php_operation_ops;
+
+/* Wrapper struct for an in-flight operation that can be associated with a
+ * PHP object */
+typedef struct wrapped_grpc_operation {
+  grpc_php_tag *tag;
+  const grpc_php_operation_ops *ops;
+  zval owner;
+  zval result;
+  /* Links in the list of operations whose completion nobody has collected
+   * yet, with wait() or drain() */
+  bool listed;
+  struct wrapped_grpc_operation *prev;
+  struct wrapped_grpc_operation *next;
+  zend_object std;
+} wrapped_grpc_operation;
+
+static inline wrapped_grpc_operation
+*wrapped_grpc_operation_from_obj(zend_object *obj) {
+  return (wrapped_grpc_operation*)((char*)(obj) -
+                                   XtOffsetOf(wrapped_grpc_operation, std));
+}
+
+#define Z_WRAPPED_GRPC_OPERATION_P(zv)            \
+  wrapped_grpc_operation_from_obj(Z_OBJ_P((zv)))
+
+/* Initializes the Operation PHP class */
+void grpc_init_operation();
+
+/* Creates an Operation object for an operation that has already been started
+ * with the given tag. The owner object is kept alive until it completes */
+void grpc_php_wrap_operation(grpc_php_tag *tag,
+                             const grpc_php_operation_ops *ops,
+                             zval *owner, zval *operation_object);
+
+/* Waits until the deadline for an operation that has already been started
+ * with the given tag and stores its result. Takes ownership of the tag,
+ * unless it returns false because the deadline passed first */
+bool grpc_php_await_operation(grpc_php_tag *tag,
+                              const grpc_php_operation_ops *ops,
+                              gpr_timespec deadline, zval *result);
+
+/* Returns the absolute time a blocking call gives up waiting at: the given
+ * Timeval if any, else grpc.wait_timeout_ms from now if that is set, else
+ * never */
+gpr_timespec grpc_php_wait_deadline(zval *deadline_obj);
+
+/* Waits for any of an array of operations to complete */
+PHP_FUNCTION(waitAny);
+
+/* Waits for all of an array of operations to complete */
+PHP_FUNCTION(waitAll);
+
+/* Collects the operations that have completed without blocking */
+PHP_FUNCTION(drain);
+
+#endif /* NET_GRPC_PHP_GRPC_OPERATION_H_ */
@@ -39,6 +39,10 @@
 #include "call_credentials.h"
 #include "server_credentials.h"
 #include "completion_queue.h"
+#include "operation.h"
+#include "byte_buffer.h"
+#include "batch.h"
+#include "metadata.h"
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -49,13 +53,18 @@
 #include <ext/standard/info.h>
 #include "php_grpc.h"
 
-// ZEND_DECLARE_MODULE_GLOBALS(grpc)
+ZEND_DECLARE_MODULE_GLOBALS(grpc)
 
 /* {{{ grpc_functions[]
  *
  * Every user visible function must have an entry in grpc_functions[].
  */
 const zend_function_entry grpc_functions[] = {
+    ZEND_NS_FE("Grpc", waitAny, NULL)
+    ZEND_NS_FE("Grpc", waitAll, NULL)
+    ZEND_NS_FE("Grpc", drain, NULL)
+    ZEND_NS_FE("Grpc", getEventNotifier, NULL)
+    ZEND_NS_FE("Grpc", stopEventNotifier, NULL)
     PHP_FE_END /* Must be the last line in grpc_functions[] */
 };
 /* }}} */
@@ -85,33 +94,29 @@ ZEND_GET_MODULE(grpc)
 
 /* {{{ PHP_INI
  */
-/* Remove comments and fill if you need to have entries in php.ini
-   PHP_INI_BEGIN()
-   STD_PHP_INI_ENTRY("grpc.global_value",      "42", PHP_INI_ALL, OnUpdateLong,
-   global_value, zend_grpc_globals, grpc_globals)
-   STD_PHP_INI_ENTRY("grpc.global_string", "foobar", PHP_INI_ALL,
-   OnUpdateString, global_string, zend_grpc_globals, grpc_globals)
-   PHP_INI_END()
-*/
+PHP_INI_BEGIN()
+    STD_PHP_INI_ENTRY("grpc.wait_timeout_ms", "0", PHP_INI_ALL, OnUpdateLong,
+                      wait_timeout_ms, zend_grpc_globals, grpc_globals)
+    STD_PHP_INI_BOOLEAN("grpc.cancel_on_timeout", "1", PHP_INI_ALL,
+                        OnUpdateBool, cancel_on_timeout, zend_grpc_globals,
+                        grpc_globals)
+PHP_INI_END()
 /* }}} */
 
 /* {{{ php_grpc_init_globals
  */
-/* Uncomment this function if you have INI entries
-   static void php_grpc_init_globals(zend_grpc_globals *grpc_globals)
-   {
-   grpc_globals->global_value = 0;
-   grpc_globals->global_string = NULL;
-   }
-*/
+static void php_grpc_init_globals(zend_grpc_globals *grpc_globals)
+{
+    grpc_globals->wait_timeout_ms = 0;
+    grpc_globals->cancel_on_timeout = 1;
+}
 /* }}} */
 
 /* {{{ PHP_MINIT_FUNCTION
  */
 PHP_MINIT_FUNCTION(grpc) {
-    /* If you have INI entries, uncomment these lines
-       REGISTER_INI_ENTRIES();
-    */
+    ZEND_INIT_MODULE_GLOBALS(grpc, php_grpc_init_globals, NULL);
+    REGISTER_INI_ENTRIES();
     /* Register call error constants */
     grpc_init();
     REGISTER_LONG_CONSTANT("Grpc\\CALL_OK", GRPC_CALL_OK,
@@ -241,6 +246,10 @@ PHP_MINIT_FUNCTION(grpc) {
     grpc_init_channel_credentials();
     grpc_init_call_credentials();
     grpc_init_server_credentials();
+    grpc_init_operation();
+    grpc_init_byte_buffer();
+    grpc_init_batch();
+    grpc_init_metadata();
     grpc_php_init_completion_queue();
     return SUCCESS;
 }
@@ -249,12 +258,11 @@ PHP_MINIT_FUNCTION(grpc) {
 /* {{{ PHP_MSHUTDOWN_FUNCTION
  */
 PHP_MSHUTDOWN_FUNCTION(grpc) {
-    /* uncomment this line if you have INI entries
-       UNREGISTER_INI_ENTRIES();
-    */
+    UNREGISTER_INI_ENTRIES();
     // WARNING: This function IS being called by PHP when the extension
     // is unloaded but the logs were somehow suppressed.
     grpc_shutdown_timeval();
+    grpc_shutdown_channel();
     grpc_php_shutdown_completion_queue();
     grpc_shutdown();
     return SUCCESS;
@@ -268,9 +276,7 @@ PHP_MINFO_FUNCTION(grpc) {
     php_info_print_table_header(2, "grpc support", "enabled");
     php_info_print_table_end();
 
-    /* Remove comments if you have entries in php.ini
-       DISPLAY_INI_ENTRIES();
-    */
+    DISPLAY_INI_ENTRIES();
 }
 /* }}} */
 /* The previous line is meant for vim and emacs, so it can correctly fold and
@@ -71,15 +71,14 @@ PHP_MSHUTDOWN_FUNCTION(grpc);
 /* Displays information about the module */
 PHP_MINFO_FUNCTION(grpc);
 
-/*
-  Declare any global variables you may need between the BEGIN
-  and END macros here:
-
-  ZEND_BEGIN_MODULE_GLOBALS(grpc)
-  zend_long global_value;
-  char *global_string;
-  ZEND_END_MODULE_GLOBALS(grpc)
-*/
+ZEND_BEGIN_MODULE_GLOBALS(grpc)
+  /* grpc.wait_timeout_ms: how long blocking calls wait, 0 for no limit */
+  zend_long wait_timeout_ms;
+  /* grpc.cancel_on_timeout: cancel batches that run past that wait */
+  zend_bool cancel_on_timeout;
+ZEND_END_MODULE_GLOBALS(grpc)
+
+ZEND_EXTERN_MODULE_GLOBALS(grpc)
 
 /* Always refer to the globals in your function as GRPC_G(variable).
    You are encouraged to rename these macros something shorter, see
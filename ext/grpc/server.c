@@ -49,8 +49,14 @@
 
 #include <grpc/grpc.h>
 #include <grpc/grpc_security.h>
+#include <grpc/support/alloc.h>
+#include <grpc/support/log.h>
+#include <grpc/support/time.h>
 
+#include "byte_buffer.h"
 #include "completion_queue.h"
+#include "metadata.h"
+#include "operation.h"
 #include "server.h"
 #include "channel.h"
 #include "server_credentials.h"
@@ -59,19 +65,280 @@
 zend_class_entry *grpc_ce_server;
 static zend_object_handlers server_ce_handlers;
 
+static void request_call_destroy(grpc_php_tag *tag);
+static void request_slots_destroy(wrapped_grpc_server *server);
+static void registered_methods_cancel(wrapped_grpc_server *server);
+
+/* Shuts the server down, failing its outstanding call requests. Calls that
+ * ignore being cancelled are cancelled again every second until
+ * grpc.wait_timeout_ms runs out, at which point the server is abandoned to
+ * core rather than holding up the worker */
+static void grpc_php_server_shutdown(wrapped_grpc_server *server) {
+  grpc_php_tag *tag;
+  gpr_timespec deadline;
+  gpr_timespec retry;
+  if (server->wrapped == NULL) {
+    return;
+  }
+  deadline = grpc_php_wait_deadline(NULL);
+  /* Outlives the request if the server is abandoned */
+  tag = gpr_malloc(sizeof(grpc_php_tag));
+  grpc_php_tag_init(tag, server->queue);
+  grpc_server_shutdown_and_notify(server->wrapped, server->queue->wrapped,
+                                  tag);
+  grpc_server_cancel_all_calls(server->wrapped);
+  if (server->pending_request != NULL) {
+    /* Shutting down fails call requests right away */
+    grpc_php_completion_queue_pluck(server->pending_request,
+                                    gpr_inf_future(GPR_CLOCK_REALTIME));
+    request_call_destroy(server->pending_request);
+    server->pending_request = NULL;
+  }
+  request_slots_destroy(server);
+  registered_methods_cancel(server);
+  while (true) {
+    retry = gpr_time_add(gpr_now(GPR_CLOCK_REALTIME),
+                         gpr_time_from_seconds(1, GPR_TIMESPAN));
+    if (grpc_php_completion_queue_pluck(tag,
+                                        gpr_time_min(deadline, retry))) {
+      break;
+    }
+    if (gpr_time_cmp(gpr_now(GPR_CLOCK_REALTIME), deadline) >= 0) {
+      gpr_log(GPR_ERROR, "Server shutdown timed out, abandoning the server");
+      /* Core still holds the tag and the queue */
+      grpc_php_completion_queue_ref(server->queue);
+      server->wrapped = NULL;
+      return;
+    }
+    grpc_server_cancel_all_calls(server->wrapped);
+  }
+  gpr_free(tag);
+  grpc_server_destroy(server->wrapped);
+  server->wrapped = NULL;
+}
+
 /* Frees and destroys an instance of wrapped_grpc_server */
 static void free_wrapped_grpc_server(zend_object *object) {
   wrapped_grpc_server *server = wrapped_grpc_server_from_obj(object);
-  if (server->wrapped != NULL) {
-    grpc_server_shutdown_and_notify(server->wrapped, completion_queue, NULL);
-    grpc_server_cancel_all_calls(server->wrapped);
-    grpc_completion_queue_pluck(completion_queue, NULL,
-                                gpr_inf_future(GPR_CLOCK_REALTIME), NULL);
-    grpc_server_destroy(server->wrapped);
+  grpc_php_server_shutdown(server);
+  if (server->registered_methods != NULL) {
+    zend_hash_destroy(server->registered_methods);
+    FREE_HASHTABLE(server->registered_methods);
+  }
+  if (server->queue != NULL) {
+    grpc_php_completion_queue_unref(server->queue);
   }
   zend_object_std_dtor(&server->std);
 }
 
+/* A method registered on the server */
+struct registered_method {
+  void *handle;
+  zend_string *method;
+  zend_string *host;
+  /* A call request that requestRegisteredCall gave up waiting for, to be
+   * picked up again by the next requestRegisteredCall */
+  grpc_php_tag *pending_request;
+};
+
+static void registered_method_free(zval *value) {
+  struct registered_method *method = Z_PTR_P(value);
+  zend_string_release(method->method);
+  if (method->host != NULL) {
+    zend_string_release(method->host);
+  }
+  efree(method);
+}
+
+/* State of a call request, from grpc_server_request_call or
+ * grpc_server_request_registered_call to its event */
+struct request_call {
+  grpc_php_tag tag;
+  grpc_call *call;
+  grpc_call_details details;
+  grpc_metadata_array metadata;
+  /* The method of a registered call request, for which core reports the
+   * deadline and the payload read ahead instead of the details */
+  struct registered_method *method;
+  gpr_timespec deadline;
+  grpc_byte_buffer *payload;
+};
+
+static void request_call_finish(grpc_php_tag *tag, zval *result) {
+  struct request_call *request = (struct request_call *)tag;
+  zval zv_call;
+  zval zv_timeval;
+  zval zv_md;
+  zend_string *message;
+
+  if (!tag->success) {
+    ZVAL_NULL(result);
+    zend_throw_exception(spl_ce_LogicException,
+                         "Failed to request a call for some reason", 1);
+    return;
+  }
+  object_init(result);
+  grpc_php_wrap_call(request->call, true, tag->queue, &zv_call);
+  grpc_php_wrap_metadata(&request->metadata, &zv_call, &zv_md);
+
+  add_property_zval(result, "call", &zv_call);
+  if (request->method == NULL) {
+    grpc_php_wrap_timeval(request->details.deadline, &zv_timeval);
+    add_property_string(result, "method", request->details.method);
+    add_property_string(result, "host", request->details.host);
+  } else {
+    grpc_php_wrap_timeval(request->deadline, &zv_timeval);
+    add_property_str(result, "method",
+                     zend_string_copy(request->method->method));
+    if (request->method->host != NULL) {
+      add_property_str(result, "host",
+                       zend_string_copy(request->method->host));
+    } else {
+      add_property_null(result, "host");
+    }
+    message = byte_buffer_to_zend_string(request->payload);
+    if (message != NULL) {
+      /* The property takes over the string without copying it */
+      add_property_str(result, "message", message);
+    } else {
+      add_property_null(result, "message");
+    }
+  }
+  add_property_zval(result, "absolute_deadline", &zv_timeval);
+  add_property_zval(result, "metadata", &zv_md);
+  zval_ptr_dtor(&zv_call);
+  zval_ptr_dtor(&zv_timeval);
+  zval_ptr_dtor(&zv_md);
+}
+
+static void request_call_destroy(grpc_php_tag *tag) {
+  struct request_call *request = (struct request_call *)tag;
+  grpc_call_details_destroy(&request->details);
+  grpc_metadata_array_destroy(&request->metadata);
+  if (request->payload != NULL) {
+    grpc_byte_buffer_destroy(request->payload);
+  }
+  efree(request);
+}
+
+/* A call request cannot be cancelled on its own, and cancelling it by
+ * shutting the whole server down would end every other request as well. A
+ * request that is given up on stays posted on the server instead, for the
+ * next wait or the shutdown to collect */
+static const grpc_php_operation_ops request_call_ops = {
+  request_call_finish,
+  NULL,
+  request_call_destroy,
+  NULL
+};
+
+/* Posts a call request for the next call to arrive at the server, or to
+ * the given registered method if it is not NULL. Throws and returns NULL if
+ * core refuses it */
+static struct request_call *request_call_start(
+    wrapped_grpc_server *server, struct registered_method *method) {
+  grpc_call_error error_code;
+  struct request_call *request = emalloc(sizeof(struct request_call));
+  grpc_php_tag_init(&request->tag, server->queue);
+  grpc_call_details_init(&request->details);
+  grpc_metadata_array_init(&request->metadata);
+  request->method = method;
+  request->payload = NULL;
+  if (method == NULL) {
+    error_code =
+      grpc_server_request_call(server->wrapped, &request->call,
+                               &request->details, &request->metadata,
+                               server->queue->wrapped,
+                               server->queue->wrapped, &request->tag);
+  } else {
+    error_code =
+      grpc_server_request_registered_call(server->wrapped, method->handle,
+                                          &request->call, &request->deadline,
+                                          &request->metadata,
+                                          &request->payload,
+                                          server->queue->wrapped,
+                                          server->queue->wrapped,
+                                          &request->tag);
+  }
+  if (error_code != GRPC_CALL_OK) {
+    request_call_destroy(&request->tag);
+    zend_throw_exception(spl_ce_LogicException, "request_call failed",
+                         (long)error_code);
+    return NULL;
+  }
+  return request;
+}
+
+/* Posts a call request in every empty slot. Returns false if core refuses
+ * one */
+static bool request_slots_fill(wrapped_grpc_server *server) {
+  struct request_call *request;
+  size_t i;
+  for (i = 0; i < server->request_slot_count; i++) {
+    if (server->request_slots[i] == NULL) {
+      request = request_call_start(server, NULL);
+      if (request == NULL) {
+        return false;
+      }
+      server->request_slots[i] = &request->tag;
+    }
+  }
+  return true;
+}
+
+/* Collects the call requests that requestRegisteredCall gave up waiting
+ * for, which shutting the server down has failed */
+static void registered_methods_cancel(wrapped_grpc_server *server) {
+  struct registered_method *method;
+  if (server->registered_methods == NULL) {
+    return;
+  }
+  ZEND_HASH_FOREACH_PTR(server->registered_methods, method) {
+    if (method->pending_request != NULL) {
+      grpc_php_completion_queue_pluck(method->pending_request,
+                                      gpr_inf_future(GPR_CLOCK_REALTIME));
+      request_call_destroy(method->pending_request);
+      method->pending_request = NULL;
+    }
+  } ZEND_HASH_FOREACH_END();
+}
+
+/* Waits until the call request of any slot completes and returns the
+ * index of its slot, or the slot count if the deadline passes first. Core
+ * does not say which posted request an incoming call goes to, so every
+ * slot is watched */
+static size_t request_slots_next(wrapped_grpc_server *server,
+                                 gpr_timespec deadline) {
+  size_t i;
+  do {
+    for (i = 0; i < server->request_slot_count; i++) {
+      if (server->request_slots[i] != NULL &&
+          grpc_php_tag_is_completed(server->request_slots[i])) {
+        return i;
+      }
+    }
+  } while (grpc_php_completion_queue_next(server->queue, deadline));
+  return server->request_slot_count;
+}
+
+/* Collects the call requests of the slots, which shutting the server down
+ * has failed, and frees the slots */
+static void request_slots_destroy(wrapped_grpc_server *server) {
+  size_t i;
+  for (i = 0; i < server->request_slot_count; i++) {
+    if (server->request_slots[i] != NULL) {
+      grpc_php_completion_queue_pluck(server->request_slots[i],
+                                      gpr_inf_future(GPR_CLOCK_REALTIME));
+      request_call_destroy(server->request_slots[i]);
+    }
+  }
+  if (server->request_slots != NULL) {
+    efree(server->request_slots);
+    server->request_slots = NULL;
+  }
+  server->request_slot_count = 0;
+}
+
 /* Initializes an instance of wrapped_grpc_call to be associated with an object
  * of a class specified by class_type */
 zend_object *create_wrapped_grpc_server(zend_class_entry *class_type) {
@@ -85,12 +352,18 @@ zend_object *create_wrapped_grpc_server(zend_class_entry *class_type) {
 }
 
 /**
- * Constructs a new instance of the Server class
+ * Constructs a new instance of the Server class. The "completion_queue" arg
+ * selects the queue for the server and its calls like it does for Channels.
+ * The "grpc.php.request_slots" arg is the number of call requests to keep
+ * posted, so that calls arriving while the script handles another one are
+ * matched right away instead of waiting in core for the next requestCall.
  * @param array $args The arguments to pass to the server (optional)
  */
 PHP_METHOD(Server, __construct) {
   wrapped_grpc_server *server = Z_WRAPPED_GRPC_SERVER_P(getThis());
   zval *args_array = NULL;
+  zval *slots;
+  zend_long slot_count = 0;
   grpc_channel_args args;
 
   /* "|a" == 1 optional array */
@@ -101,66 +374,227 @@ PHP_METHOD(Server, __construct) {
     return;
   }
   if (args_array == NULL) {
+    server->queue = grpc_php_completion_queue_ref(default_completion_queue);
     server->wrapped = grpc_server_create(NULL, NULL);
   } else {
+    slots = zend_hash_str_find(Z_ARRVAL_P(args_array),
+                               "grpc.php.request_slots",
+                               sizeof("grpc.php.request_slots") - 1);
+    if (slots != NULL) {
+      if (Z_TYPE_P(slots) != IS_LONG || Z_LVAL_P(slots) < 0) {
+        zend_throw_exception(spl_ce_InvalidArgumentException,
+                             "grpc.php.request_slots must be a "
+                             "non-negative integer", 1);
+        return;
+      }
+      slot_count = Z_LVAL_P(slots);
+    }
+    server->queue = grpc_php_take_completion_queue_arg(args_array);
+    if (server->queue == NULL) {
+      return;
+    }
+    /* Allocated once nothing can fail, as the object is freed without
+     * its slots being looked at if the constructor throws */
+    if (slot_count > 0) {
+      server->request_slot_count = slot_count;
+      server->request_slots = ecalloc(server->request_slot_count,
+                                      sizeof(grpc_php_tag *));
+    }
     php_grpc_read_args_array(args_array, &args);
     server->wrapped = grpc_server_create(&args, NULL);
     efree(args.args);
   }
   grpc_server_register_completion_queue(server->wrapped,
-                                        completion_queue, NULL);
+                                        server->queue->wrapped, NULL);
 }
 
 /**
  * Request a call on a server. Creates a single GRPC_SERVER_RPC_NEW event.
- * @param long $tag_new The tag to associate with the new request
- * @param long $tag_cancel The tag to use if the call is cancelled
- * @return Void
+ * If no call arrives by the wait deadline, null is returned and the request
+ * stays posted for the next requestCall to pick up. A server with request
+ * slots refills them and returns the call of whichever slot core matched
+ * first, reposting that slot.
+ * @param Timeval $wait_deadline The time to stop waiting at. Defaults to
+ *     grpc.wait_timeout_ms from now, or no limit (optional)
+ * @return object Object with the new call and its details, or null
  */
 PHP_METHOD(Server, requestCall) {
-  grpc_call_error error_code;
   wrapped_grpc_server *server = Z_WRAPPED_GRPC_SERVER_P(getThis());
-  grpc_call *call;
-  grpc_call_details details;
-  grpc_metadata_array metadata;
-  grpc_event event;
-
-  object_init(return_value);
-  grpc_call_details_init(&details);
-  grpc_metadata_array_init(&metadata);
-  error_code =
-    grpc_server_request_call(server->wrapped, &call, &details, &metadata,
-                             completion_queue, completion_queue, NULL);
-  if (error_code != GRPC_CALL_OK) {
-    zend_throw_exception(spl_ce_LogicException, "request_call failed",
-                         (long)error_code);
-    goto cleanup;
+  zval *deadline_obj = NULL;
+  struct request_call *request;
+  grpc_php_tag *tag;
+  size_t index;
+
+  /* "|O" == 1 optional object */
+  if (zend_parse_parameters(ZEND_NUM_ARGS(), "|O", &deadline_obj,
+                            grpc_ce_timeval) == FAILURE) {
+    zend_throw_exception(spl_ce_InvalidArgumentException,
+                         "request_call expects an optional Timeval", 1);
+    return;
   }
-  event = grpc_completion_queue_pluck(completion_queue, NULL,
-                                      gpr_inf_future(GPR_CLOCK_REALTIME),
-                                      NULL);
-  if (!event.success) {
+  if (server->wrapped == NULL) {
     zend_throw_exception(spl_ce_LogicException,
-                         "Failed to request a call for some reason", 1);
-    goto cleanup;
+                         "request_call on a server that has shut down", 1);
+    return;
+  }
+  if (server->request_slot_count > 0) {
+    if (!request_slots_fill(server)) {
+      return;
+    }
+    index = request_slots_next(server,
+                               grpc_php_wait_deadline(deadline_obj));
+    if (index == server->request_slot_count) {
+      RETURN_NULL();
+    }
+    tag = server->request_slots[index];
+    /* Repost the slot before handing out its call, so that core keeps as
+     * many requests to match */
+    request = request_call_start(server, NULL);
+    if (request != NULL) {
+      server->request_slots[index] = &request->tag;
+    } else {
+      /* Left empty for the next requestCall, which reports the error */
+      zend_clear_exception();
+      server->request_slots[index] = NULL;
+    }
+    request_call_finish(tag, return_value);
+    request_call_destroy(tag);
+    return;
+  }
+  if (server->pending_request != NULL) {
+    request = (struct request_call *)server->pending_request;
+    server->pending_request = NULL;
+    goto wait;
+  }
+  request = request_call_start(server, NULL);
+  if (request == NULL) {
+    return;
   }
-  zval zv_call;
-  zval zv_timeval;
-  zval zv_md;
-  grpc_php_wrap_call(call, true, &zv_call);
-  grpc_php_wrap_timeval(details.deadline, &zv_timeval);
-  grpc_parse_metadata_array(&metadata, &zv_md);
 
-  add_property_zval(return_value, "call", &zv_call);
-  add_property_string(return_value, "method", details.method);
-  add_property_string(return_value, "host", details.host);
-  add_property_zval(return_value, "absolute_deadline", &zv_timeval);
-  add_property_zval(return_value, "metadata", &zv_md);
+ wait:
+  if (!grpc_php_await_operation(&request->tag, &request_call_ops,
+                                grpc_php_wait_deadline(deadline_obj),
+                                return_value)) {
+    server->pending_request = &request->tag;
+    RETURN_NULL();
+  }
+}
 
- cleanup:
-  grpc_call_details_destroy(&details);
-  grpc_metadata_array_destroy(&metadata);
-  RETURN_DESTROY_ZVAL(return_value);
+/**
+ * Register a method before the server starts. Its calls are no longer
+ * returned by requestCall but by requestRegisteredCall, and core reads the
+ * request message ahead, so a unary call arrives complete in one event.
+ * @param string $method The method name
+ * @param string $host The host the calls are made to (optional)
+ * @return Void
+ */
+PHP_METHOD(Server, registerMethod) {
+  wrapped_grpc_server *server = Z_WRAPPED_GRPC_SERVER_P(getThis());
+  zend_string *method_name;
+  zend_string *host = NULL;
+  struct registered_method *method;
+  zend_string *key;
+  void *handle;
+
+  /* "S|S!" == 1 string, 1 optional nullable string */
+  if (zend_parse_parameters(ZEND_NUM_ARGS(), "S|S!", &method_name, &host) ==
+      FAILURE) {
+    zend_throw_exception(spl_ce_InvalidArgumentException,
+                         "register_method expects a string and an optional "
+                         "string", 1);
+    return;
+  }
+  if (server->wrapped == NULL) {
+    zend_throw_exception(spl_ce_LogicException,
+                         "register_method on a server that has shut down",
+                         1);
+    return;
+  }
+  handle = grpc_server_register_method(
+      server->wrapped, ZSTR_VAL(method_name),
+      host == NULL ? NULL : ZSTR_VAL(host),
+      GRPC_SRM_PAYLOAD_READ_INITIAL_BYTE_BUFFER, 0);
+  if (handle == NULL) {
+    zend_throw_exception(spl_ce_LogicException,
+                         "register_method failed: the method is already "
+                         "registered or the server has started", 1);
+    return;
+  }
+  if (server->registered_methods == NULL) {
+    ALLOC_HASHTABLE(server->registered_methods);
+    zend_hash_init(server->registered_methods, 8, NULL,
+                   registered_method_free, 0);
+  }
+  method = emalloc(sizeof(struct registered_method));
+  method->handle = handle;
+  method->method = zend_string_copy(method_name);
+  method->host = host == NULL ? NULL : zend_string_copy(host);
+  method->pending_request = NULL;
+  key = grpc_php_method_key(method_name, host);
+  zend_hash_update_ptr(server->registered_methods, key, method);
+  zend_string_release(key);
+}
+
+/**
+ * Request a call to a method registered with registerMethod. Waits like
+ * requestCall, and the result has the request message in its message
+ * property as well, or null if the client sent none.
+ * @param string $method The method name
+ * @param string $host The host the method was registered with (optional)
+ * @param Timeval $wait_deadline The time to stop waiting at. Defaults to
+ *     grpc.wait_timeout_ms from now, or no limit (optional)
+ * @return object Object with the new call, its details and its message, or
+ *     null
+ */
+PHP_METHOD(Server, requestRegisteredCall) {
+  wrapped_grpc_server *server = Z_WRAPPED_GRPC_SERVER_P(getThis());
+  zend_string *method_name;
+  zend_string *host = NULL;
+  zval *deadline_obj = NULL;
+  struct registered_method *method = NULL;
+  struct request_call *request;
+  zend_string *key;
+
+  /* "S|S!O" == 1 string, 1 optional nullable string, 1 optional object */
+  if (zend_parse_parameters(ZEND_NUM_ARGS(), "S|S!O", &method_name, &host,
+                            &deadline_obj, grpc_ce_timeval) == FAILURE) {
+    zend_throw_exception(spl_ce_InvalidArgumentException,
+                         "request_registered_call expects a string, an "
+                         "optional string and an optional Timeval", 1);
+    return;
+  }
+  if (server->wrapped == NULL) {
+    zend_throw_exception(spl_ce_LogicException,
+                         "request_registered_call on a server that has "
+                         "shut down", 1);
+    return;
+  }
+  if (server->registered_methods != NULL) {
+    key = grpc_php_method_key(method_name, host);
+    method = zend_hash_find_ptr(server->registered_methods, key);
+    zend_string_release(key);
+  }
+  if (method == NULL) {
+    zend_throw_exception(spl_ce_InvalidArgumentException,
+                         "request_registered_call on a method that was not "
+                         "registered", 1);
+    return;
+  }
+  if (method->pending_request != NULL) {
+    request = (struct request_call *)method->pending_request;
+    method->pending_request = NULL;
+  } else {
+    request = request_call_start(server, method);
+    if (request == NULL) {
+      return;
+    }
+  }
+  if (!grpc_php_await_operation(&request->tag, &request_call_ops,
+                                grpc_php_wait_deadline(deadline_obj),
+                                return_value)) {
+    method->pending_request = &request->tag;
+    RETURN_NULL();
+  }
 }
 
 /**
@@ -214,8 +648,10 @@ PHP_METHOD(Server, start) {
 }
 
 static zend_function_entry server_methods[] = {
-  PHP_ME(Server, __construct, NULL, ZEND_ACC_PUBLIC | ZEND_ACC_CTOR)
+  PHP_ME(Server, __construct, NULL, ZEND_ACC_PUBLIC)
   PHP_ME(Server, requestCall, NULL, ZEND_ACC_PUBLIC)
+  PHP_ME(Server, registerMethod, NULL, ZEND_ACC_PUBLIC)
+  PHP_ME(Server, requestRegisteredCall, NULL, ZEND_ACC_PUBLIC)
   PHP_ME(Server, addHttp2Port, NULL, ZEND_ACC_PUBLIC)
   PHP_ME(Server, addSecureHttp2Port, NULL, ZEND_ACC_PUBLIC)
   PHP_ME(Server, start, NULL, ZEND_ACC_PUBLIC)
@@ -45,12 +45,24 @@
 
 #include <grpc/grpc.h>
 
+#include "completion_queue.h"
+
 /* Class entry for the Server PHP class */
 extern zend_class_entry *grpc_ce_server;
 
 /* Wrapper struct for grpc_server that can be associated with a PHP object */
 typedef struct wrapped_grpc_server {
   grpc_server *wrapped;
+  grpc_php_completion_queue *queue;
+  /* A call request that requestCall gave up waiting for, to be picked up
+   * again by the next requestCall */
+  grpc_php_tag *pending_request;
+  /* Call requests kept posted ahead of requestCall, when the
+   * grpc.php.request_slots arg is set. Empty slots are NULL */
+  grpc_php_tag **request_slots;
+  size_t request_slot_count;
+  /* Methods registered with registerMethod, by method and host */
+  HashTable *registered_methods;
   zend_object std;
 } wrapped_grpc_server;
 
@@ -0,0 +1,27 @@
+--TEST--
+Test clone Batch and BatchResult : error conditions
+--SKIPIF--
+<?php
+if (!extension_loaded("grpc"))
+    print "skip";
+?>
+--FILE--
+<?php
+$batch = new Grpc\Batch([Grpc\OP_SEND_INITIAL_METADATA => true]);
+try {
+    clone $batch;
+} catch (Error $e) {
+    echo "Batch: ", get_class($e), "\n";
+}
+$result = new Grpc\BatchResult();
+try {
+    clone $result;
+} catch (Error $e) {
+    echo "BatchResult: ", get_class($e), "\n";
+}
+?>
+===DONE===
+--EXPECT--
+Batch: Error
+BatchResult: Error
+===DONE===
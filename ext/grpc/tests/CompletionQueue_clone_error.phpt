@@ -0,0 +1,20 @@
+--TEST--
+Test clone CompletionQueue : error conditions
+--SKIPIF--
+<?php
+if (!extension_loaded("grpc"))
+    print "skip";
+?>
+--FILE--
+<?php
+$queue = new Grpc\CompletionQueue();
+try {
+    clone $queue;
+} catch (Error $e) {
+    echo "clone: ", get_class($e), "\n";
+}
+?>
+===DONE===
+--EXPECT--
+clone: Error
+===DONE===
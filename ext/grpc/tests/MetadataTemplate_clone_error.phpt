@@ -0,0 +1,28 @@
+--TEST--
+Test clone MetadataTemplate : error conditions
+--SKIPIF--
+<?php
+if (!extension_loaded("grpc"))
+    print "skip";
+?>
+--FILE--
+<?php
+$template = new Grpc\MetadataTemplate(['key' => ['value']]);
+try {
+    clone $template;
+} catch (Error $e) {
+    echo "clone: ", get_class($e), "\n";
+}
+var_dump($template->toArray());
+?>
+===DONE===
+--EXPECT--
+clone: Error
+array(1) {
+  ["key"]=>
+  array(1) {
+    [0]=>
+    string(5) "value"
+  }
+}
+===DONE===
@@ -0,0 +1,22 @@
+--TEST--
+Test clone Metadata : error conditions
+--SKIPIF--
+<?php
+if (!extension_loaded("grpc"))
+    print "skip";
+?>
+--FILE--
+<?php
+$metadata = new Grpc\Metadata();
+try {
+    clone $metadata;
+} catch (Error $e) {
+    echo "clone: ", get_class($e), "\n";
+}
+var_dump(count($metadata));
+?>
+===DONE===
+--EXPECT--
+clone: Error
+int(0)
+===DONE===
@@ -0,0 +1,31 @@
+--TEST--
+Test new Operation() and clone : error conditions
+--SKIPIF--
+<?php
+if (!extension_loaded("grpc"))
+    print "skip";
+?>
+--FILE--
+<?php
+try {
+    new Grpc\Operation();
+} catch (Error $e) {
+    echo "construct: ", get_class($e), "\n";
+}
+$channel = new Grpc\Channel('localhost:1', []);
+$call = new Grpc\Call($channel, 'dummy_method', Grpc\Timeval::infFuture());
+$operation = $call->startBatchAsync([
+    Grpc\OP_SEND_INITIAL_METADATA => [],
+]);
+try {
+    clone $operation;
+} catch (Error $e) {
+    echo "clone: ", get_class($e), "\n";
+}
+$call->cancel();
+?>
+===DONE===
+--EXPECT--
+construct: Error
+clone: Error
+===DONE===
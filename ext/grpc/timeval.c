@@ -246,7 +246,7 @@ PHP_METHOD(Timeval, sleepUntil) {
 }
 
 static zend_function_entry timeval_methods[] = {
-  PHP_ME(Timeval, __construct, NULL, ZEND_ACC_PUBLIC | ZEND_ACC_CTOR)
+  PHP_ME(Timeval, __construct, NULL, ZEND_ACC_PUBLIC)
   PHP_ME(Timeval, add, NULL, ZEND_ACC_PUBLIC)
   PHP_ME(Timeval, compare, NULL, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
   PHP_ME(Timeval, infFuture, NULL, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
@@ -40,6 +40,15 @@ abstract class AbstractCall
     protected $deserialize;
     protected $metadata;
 
+    // whether to post the receive for the next message early
+    private $read_ahead;
+    // the Operation of the receive posted early, if any
+    private $pending_read;
+    // the Batch for receiving one message
+    private $read_batch;
+    // the Operation of a message still being sent, if any
+    protected $pending_write;
+
     /**
      * Create a new Call wrapper object.
      *
@@ -48,7 +57,12 @@ abstract class AbstractCall
      *                              remote server
      * @param callback $deserialize A callback function to deserialize
      *                              the response
-     * @param array    $options     Call options (optional)
+     * @param array    $options     Call options (optional), possible keys:
+     *                              'timeout' => microseconds
+     *                              'call_credentials_callback' => callable
+     *                              'read_ahead' => true to receive each
+     *                              message while the one before it is
+     *                              being handled
      */
     public function __construct(Channel $channel,
                                 $method,
@@ -66,6 +80,9 @@ abstract class AbstractCall
         $this->call = new Call($channel, $method, $deadline);
         $this->deserialize = $deserialize;
         $this->metadata = null;
+        $this->read_ahead = !empty($options['read_ahead']);
+        $this->pending_read = null;
+        $this->read_batch = null;
         if (isset($options['call_credentials_callback']) &&
             is_callable($call_credentials_callback =
                         $options['call_credentials_callback'])) {
@@ -80,6 +97,11 @@ abstract class AbstractCall
      */
     public function getMetadata()
     {
+        // Received metadata is only converted to an array when asked for
+        if ($this->metadata instanceof Metadata) {
+            $this->metadata = $this->metadata->toArray();
+        }
+
         return $this->metadata;
     }
 
@@ -99,6 +121,191 @@ abstract class AbstractCall
         $this->call->cancel();
     }
 
+    /**
+     * Receive the next message, along with the initial metadata if that has
+     * not been received yet. With read-ahead on, the receive for the message
+     * after it is posted before this returns. Core allows one receive at a
+     * time, so that is as far ahead as reads go. Waiting for a receive posted
+     * early is bounded like startBatch.
+     *
+     * @return string The serialized message, or null if there are no more
+     *
+     * @throws \RuntimeException if the wait timed out and left the receive
+     *                           in flight, for the next receive() to wait
+     *                           for again
+     */
+    protected function receive()
+    {
+        if ($this->pending_read !== null) {
+            $event = $this->pending_read->wait();
+        } elseif ($this->metadata === null) {
+            $event = $this->call->startBatch([
+                OP_RECV_INITIAL_METADATA => true,
+                OP_RECV_MESSAGE => true,
+            ]);
+        } else {
+            if ($this->read_batch === null) {
+                $this->read_batch = new Batch([OP_RECV_MESSAGE => true]);
+            }
+            $event = $this->call->runBatch($this->read_batch);
+        }
+        if (isset($event->operation)) {
+            // Gave up waiting without cancelling the receive, which must not
+            // pass for the end of the stream
+            $this->pending_read = $event->operation;
+            throw new \RuntimeException(
+                'Timed out waiting for the next message');
+        }
+        $this->pending_read = null;
+        if ($this->metadata === null) {
+            $this->metadata = $event->metadata;
+        }
+        if ($this->read_ahead && $event->message !== null) {
+            $this->pending_read = $this->call->startBatchAsync([
+                OP_RECV_MESSAGE => true,
+            ]);
+        }
+
+        return $event->message;
+    }
+
+    /**
+     * Post the receive for the next message without waiting for it. The
+     * next receive() returns its message.
+     *
+     * @return Operation The receive, which completes when the message has
+     *                   arrived
+     */
+    protected function receiveAsync()
+    {
+        if ($this->pending_read === null) {
+            $batch = [OP_RECV_MESSAGE => true];
+            if ($this->metadata === null) {
+                $batch[OP_RECV_INITIAL_METADATA] = true;
+            }
+            $this->pending_read = $this->call->startBatchAsync($batch);
+        }
+
+        return $this->pending_read;
+    }
+
+    /**
+     * Wait for the server to send the status, after any receive posted
+     * early, and return it.
+     *
+     * @return object The status object
+     */
+    protected function receiveStatus()
+    {
+        if ($this->pending_read !== null) {
+            // Its message was never asked for
+            $event = $this->pending_read->wait();
+            if (!isset($event->operation)) {
+                $this->pending_read = null;
+            }
+        }
+        $status_event = $this->call->startBatch([
+            OP_RECV_STATUS_ON_CLIENT => true,
+        ]);
+
+        return $this->convertStatus($status_event->status);
+    }
+
+    /**
+     * Give a received status its trailing metadata as an array, the same
+     * as getMetadata() does for the initial metadata.
+     *
+     * @param object $status The status received from the server
+     *
+     * @return object The status object, with integer $code, string $details,
+     *                and array $metadata members
+     */
+    protected function convertStatus($status)
+    {
+        if (isset($status->metadata) &&
+            $status->metadata instanceof Metadata) {
+            $status->metadata = $status->metadata->toArray();
+        }
+
+        return $status;
+    }
+
+    /**
+     * Serialize and send many messages, handing them to the extension in
+     * windows of up to $options['window'] messages (100 by default). Each
+     * window is flushed when its last message is sent. The writes stop at
+     * the first message whose send timed out; if grpc.cancel_on_timeout is
+     * off, that send is left in flight for the next write to wait for.
+     *
+     * @param array|Traversable $data    The messages to write
+     * @param array             $options an array of options, possible keys:
+     *                                   'flags' => a number
+     *                                   'window' => a number
+     *
+     * @return int The number of messages sent
+     */
+    protected function writeAll($data, $options)
+    {
+        $flags = isset($options['flags']) ? $options['flags'] : 0;
+        $window = isset($options['window']) ? max(1, $options['window']) : 100;
+        $this->finishWrite();
+        $sent = 0;
+        $messages = [];
+        foreach ($data as $message) {
+            $messages[] = $message->serialize();
+            if (count($messages) === $window) {
+                if (!$this->writeWindow($messages, $flags, $sent)) {
+                    return $sent;
+                }
+                $messages = [];
+            }
+        }
+        if (!empty($messages)) {
+            $this->writeWindow($messages, $flags, $sent);
+        }
+
+        return $sent;
+    }
+
+    /**
+     * Send one window of serialized messages for writeAll.
+     *
+     * @param array $messages The serialized messages
+     * @param int   $flags    The write flags for every message
+     * @param int   $sent     The count of messages sent, to add to
+     *
+     * @return bool Whether every message of the window was sent
+     */
+    private function writeWindow(array $messages, $flags, &$sent)
+    {
+        $written = $this->call->writeMany($messages, $flags,
+                                          $this->pending_write);
+        $sent += $written;
+
+        return $written === count($messages);
+    }
+
+    /**
+     * Wait for the message started by writeAsync or left in flight by
+     * writeAll, if any, to be sent. The wait is bounded by
+     * grpc.wait_timeout_ms like startBatch.
+     *
+     * @throws \RuntimeException if the wait timed out and left the send in
+     *                           flight
+     */
+    protected function finishWrite()
+    {
+        if ($this->pending_write !== null) {
+            $event = $this->pending_write->wait();
+            if (isset($event->operation)) {
+                // Core takes no other send until this one completes
+                throw new \RuntimeException(
+                    'Timed out waiting for the previous write to be sent');
+            }
+            $this->pending_write = null;
+        }
+    }
+
     /**
      * Deserialize a response value to an object.
      *
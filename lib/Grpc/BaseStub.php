@@ -42,16 +42,27 @@ class BaseStub
 {
     private $hostname;
     private $channel;
+    private $channel_pool;
+
+    // the methods registered on the channels so far, as keys
+    private $registered_methods;
 
     // a callback function
     private $update_metadata;
 
+    // metadata sent on every call, as a MetadataTemplate
+    private $metadata_template;
+
     /**
      * @param $hostname string
      * @param $opts array
      *  - 'update_metadata': (optional) a callback function which takes in a
      * metadata array, and returns an updated metadata array
      *  - 'grpc.primary_user_agent': (optional) a user-agent string
+     *  - 'max_channels': (optional) spread calls over up to this many
+     * channels, see ChannelPool
+     *  - 'metadata': (optional) a metadata map or MetadataTemplate to send
+     * on every call, under the metadata of the call itself
      */
     public function __construct($hostname, $opts)
     {
@@ -67,6 +78,13 @@ class BaseStub
             }
             unset($opts['update_metadata']);
         }
+        $this->metadata_template = null;
+        if (isset($opts['metadata'])) {
+            $this->metadata_template =
+                $opts['metadata'] instanceof MetadataTemplate ?
+                $opts['metadata'] : new MetadataTemplate($opts['metadata']);
+            unset($opts['metadata']);
+        }
         $package_config = json_decode(
             file_get_contents(dirname(__FILE__).'/../../composer.json'), true);
         if (!empty($opts['grpc.primary_user_agent'])) {
@@ -81,7 +99,22 @@ class BaseStub
                                  'required. Please see one of the '.
                                  'ChannelCredentials::create methods');
         }
-        $this->channel = new Channel($hostname, $opts);
+        $this->registered_methods = [];
+        $this->channel_pool = null;
+        if (isset($opts['max_channels'])) {
+            $max_channels = $opts['max_channels'];
+            unset($opts['max_channels']);
+            if ($max_channels > 1) {
+                $this->channel_pool = new ChannelPool($hostname,
+                                                      $opts,
+                                                      $max_channels);
+            }
+        }
+        if ($this->channel_pool !== null) {
+            $this->channel = $this->channel_pool->getChannel();
+        } else {
+            $this->channel = new Channel($hostname, $opts);
+        }
     }
 
     /**
@@ -149,7 +182,34 @@ class BaseStub
      */
     public function close()
     {
-        $this->channel->close();
+        if ($this->channel_pool !== null) {
+            $this->channel_pool->close();
+        } else {
+            $this->channel->close();
+        }
+    }
+
+    /**
+     * @param string $method The method the call is made to, which is
+     *                       registered on the channels the first time
+     *
+     * @return Channel The channel to start the next call on
+     */
+    private function _get_channel($method)
+    {
+        if (!isset($this->registered_methods[$method])) {
+            if ($this->channel_pool !== null) {
+                $this->channel_pool->registerMethod($method);
+            } else {
+                $this->channel->registerMethods([$method]);
+            }
+            $this->registered_methods[$method] = true;
+        }
+        if ($this->channel_pool !== null) {
+            return $this->channel_pool->getChannel();
+        }
+
+        return $this->channel;
     }
 
     /**
@@ -168,15 +228,52 @@ class BaseStub
     }
 
     /**
-     * validate and normalize the metadata array.
+     * Pass the metadata of a call through the update_metadata callback, if
+     * there is one. The callback is given a metadata array, also when the
+     * call was made with a MetadataTemplate.
+     *
+     * @param $metadata    The metadata map, or a MetadataTemplate
+     * @param $jwt_aud_uri The JWT audience URI of the call
+     *
+     * @return array|MetadataTemplate The updated metadata
+     */
+    private function _update_metadata($metadata, $jwt_aud_uri)
+    {
+        if (!is_callable($this->update_metadata)) {
+            return $metadata;
+        }
+        if ($metadata instanceof MetadataTemplate) {
+            $metadata = $metadata->toArray();
+        }
+
+        return call_user_func($this->update_metadata,
+                              $metadata,
+                              $jwt_aud_uri);
+    }
+
+    /**
+     * validate and normalize the metadata array, on top of the metadata
+     * every call sends. Calls without metadata of their own send the stub's
+     * MetadataTemplate as it is; otherwise a plain array is returned, as a
+     * template built for a single call would not pay for itself.
      *
-     * @param $metadata The metadata map
+     * @param $metadata The metadata map, or a MetadataTemplate
      *
-     * @return $metadata Validated and key-normalized metadata map
+     * @return array|MetadataTemplate Validated and key-normalized metadata
      * @throw InvalidArgumentException if key contains invalid characters
      */
     private function _validate_and_normalize_metadata($metadata)
     {
+        if ($metadata instanceof MetadataTemplate) {
+            if ($this->metadata_template === null) {
+                return $metadata;
+            }
+            $metadata = $metadata->toArray();
+        }
+        if (empty($metadata)) {
+            return $this->metadata_template === null ? [] :
+                $this->metadata_template;
+        }
         $metadata_copy = [];
         foreach ($metadata as $key => $value) {
             if (!preg_match('/^[A-Za-z\d_-]+$/', $key)) {
@@ -186,8 +283,12 @@ class BaseStub
             }
             $metadata_copy[strtolower($key)] = $value;
         }
+        if ($this->metadata_template === null) {
+            return $metadata_copy;
+        }
 
-        return $metadata_copy;
+        // The call's own values replace those of the same keys
+        return $metadata_copy + $this->metadata_template->toArray();
     }
 
     /* This class is intended to be subclassed by generated code, so
@@ -200,7 +301,8 @@ class BaseStub
      * @param string $method The name of the method to call
      * @param $argument The argument to the method
      * @param callable $deserialize A function that deserializes the response
-     * @param array    $metadata    A metadata map to send to the server
+     * @param array    $metadata    A metadata map or MetadataTemplate to
+     *                              send to the server
      *
      * @return SimpleSurfaceActiveCall The active call object
      */
@@ -210,16 +312,12 @@ class BaseStub
                                    $metadata = [],
                                    $options = [])
     {
-        $call = new UnaryCall($this->channel,
+        $call = new UnaryCall($this->_get_channel($method),
                               $method,
                               $deserialize,
                               $options);
         $jwt_aud_uri = $this->_get_jwt_aud_uri($method);
-        if (is_callable($this->update_metadata)) {
-            $metadata = call_user_func($this->update_metadata,
-                                        $metadata,
-                                        $jwt_aud_uri);
-        }
+        $metadata = $this->_update_metadata($metadata, $jwt_aud_uri);
         $metadata = $this->_validate_and_normalize_metadata(
             $metadata);
         $call->start($argument, $metadata, $options);
@@ -227,6 +325,89 @@ class BaseStub
         return $call;
     }
 
+    /**
+     * Call a remote method that takes a single argument and has a single
+     * output once for every argument. The calls are in flight together, up
+     * to a limit, and are waited for on their completion queue as a group.
+     *
+     * @param string   $method      The name of the method to call
+     * @param array    $arguments   The arguments to make a call with each
+     * @param callable $deserialize A function that deserializes the responses
+     * @param array    $metadata    A metadata map or MetadataTemplate to
+     *                              send with every call
+     * @param array    $options     The options of every call, and
+     *                              'concurrency' => the most calls to have
+     *                              in flight at once (default 100)
+     *
+     * @return array [response data, status] for every argument, under the
+     *               argument's key and in the order of the arguments
+     */
+    public function _simpleRequestMany($method,
+                                       array $arguments,
+                                       $deserialize,
+                                       $metadata = [],
+                                       $options = [])
+    {
+        $concurrency = 100;
+        if (isset($options['concurrency'])) {
+            $concurrency = $options['concurrency'];
+            unset($options['concurrency']);
+            if ($concurrency < 1) {
+                throw new \InvalidArgumentException(
+                    'concurrency must be positive');
+            }
+        }
+        $results = [];
+        $pending = [];
+        foreach ($arguments as $key => $argument) {
+            if (count($pending) >= $concurrency) {
+                $this->_wait_any_call($pending, $results);
+            }
+            $pending[$key] = $this->_simpleRequest($method,
+                                                   $argument,
+                                                   $deserialize,
+                                                   $metadata,
+                                                   $options);
+        }
+        while (!empty($pending)) {
+            $this->_wait_any_call($pending, $results);
+        }
+        $ordered = [];
+        foreach ($arguments as $key => $argument) {
+            $ordered[$key] = $results[$key];
+        }
+
+        return $ordered;
+    }
+
+    /**
+     * Wait until at least one of the pending unary calls has completed, and
+     * move the results of the completed ones to $results. The wait is
+     * bounded by grpc.wait_timeout_ms like UnaryCall::wait().
+     *
+     * @param array $pending The UnaryCalls in flight, by argument key
+     * @param array $results The results of the completed calls, by argument
+     *                       key
+     */
+    private function _wait_any_call(array &$pending, array &$results)
+    {
+        $operations = [];
+        foreach ($pending as $key => $call) {
+            $operations[$key] = $call->getOperation();
+        }
+        $completed = waitAny($operations);
+        if (empty($completed)) {
+            // grpc.wait_timeout_ms ran out, so the oldest call gets the
+            // timeout handling of a single wait()
+            reset($pending);
+            $completed = [key($pending)];
+        }
+        foreach ($completed as $key) {
+            $results[$key] = $pending[$key]->wait();
+            unset($pending[$key]);
+        }
+    }
+
     /**
      * Call a remote method that takes a stream of arguments and has a single
      * output.
@@ -235,7 +416,8 @@ class BaseStub
      * @param $arguments An array or Traversable of arguments to stream to the
      *     server
      * @param callable $deserialize A function that deserializes the response
-     * @param array    $metadata    A metadata map to send to the server
+     * @param array    $metadata    A metadata map or MetadataTemplate to
+     *                              send to the server
      *
      * @return ClientStreamingSurfaceActiveCall The active call object
      */
@@ -244,16 +426,12 @@ class BaseStub
                                          $metadata = [],
                                          $options = [])
     {
-        $call = new ClientStreamingCall($this->channel,
+        $call = new ClientStreamingCall($this->_get_channel($method),
                                         $method,
                                         $deserialize,
                                         $options);
         $jwt_aud_uri = $this->_get_jwt_aud_uri($method);
-        if (is_callable($this->update_metadata)) {
-            $metadata = call_user_func($this->update_metadata,
-                                        $metadata,
-                                        $jwt_aud_uri);
-        }
+        $metadata = $this->_update_metadata($metadata, $jwt_aud_uri);
         $metadata = $this->_validate_and_normalize_metadata(
             $metadata);
         $call->start($metadata);
@@ -268,7 +446,8 @@ class BaseStub
      * @param string $method The name of the method to call
      * @param $argument The argument to the method
      * @param callable $deserialize A function that deserializes the responses
-     * @param array    $metadata    A metadata map to send to the server
+     * @param array    $metadata    A metadata map or MetadataTemplate to
+     *                              send to the server
      *
      * @return ServerStreamingSurfaceActiveCall The active call object
      */
@@ -278,16 +457,12 @@ class BaseStub
                                          $metadata = [],
                                          $options = [])
     {
-        $call = new ServerStreamingCall($this->channel,
+        $call = new ServerStreamingCall($this->_get_channel($method),
                                         $method,
                                         $deserialize,
                                         $options);
         $jwt_aud_uri = $this->_get_jwt_aud_uri($method);
-        if (is_callable($this->update_metadata)) {
-            $metadata = call_user_func($this->update_metadata,
-                                        $metadata,
-                                        $jwt_aud_uri);
-        }
+        $metadata = $this->_update_metadata($metadata, $jwt_aud_uri);
         $metadata = $this->_validate_and_normalize_metadata(
             $metadata);
         $call->start($argument, $metadata, $options);
@@ -300,7 +475,8 @@ class BaseStub
      *
      * @param string   $method      The name of the method to call
      * @param callable $deserialize A function that deserializes the responses
-     * @param array    $metadata    A metadata map to send to the server
+     * @param array    $metadata    A metadata map or MetadataTemplate to
+     *                              send to the server
      *
      * @return BidiStreamingSurfaceActiveCall The active call object
      */
@@ -309,16 +485,12 @@ class BaseStub
                                  $metadata = [],
                                  $options = [])
     {
-        $call = new BidiStreamingCall($this->channel,
+        $call = new BidiStreamingCall($this->_get_channel($method),
                                       $method,
                                       $deserialize,
                                       $options);
         $jwt_aud_uri = $this->_get_jwt_aud_uri($method);
-        if (is_callable($this->update_metadata)) {
-            $metadata = call_user_func($this->update_metadata,
-                                        $metadata,
-                                        $jwt_aud_uri);
-        }
+        $metadata = $this->_update_metadata($metadata, $jwt_aud_uri);
         $metadata = $this->_validate_and_normalize_metadata(
             $metadata);
         $call->start($metadata);
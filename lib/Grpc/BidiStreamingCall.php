@@ -53,22 +53,26 @@ class BidiStreamingCall extends AbstractCall
     }
 
     /**
-     * Reads the next value from the server.
+     * Reads the next value from the server. If readAsync was called, this
+     * returns the message it received.
      *
      * @return The next value from the server, or null if there is none
      */
     public function read()
     {
-        $batch = [OP_RECV_MESSAGE => true];
-        if ($this->metadata === null) {
-            $batch[OP_RECV_INITIAL_METADATA] = true;
-        }
-        $read_event = $this->call->startBatch($batch);
-        if ($this->metadata === null) {
-            $this->metadata = $read_event->metadata;
-        }
+        return $this->deserializeResponse($this->receive());
+    }
 
-        return $this->deserializeResponse($read_event->message);
+    /**
+     * Start reading the next value from the server, without blocking
+     * writes in the meantime. Only one read is outstanding at a time, so
+     * this returns the same Operation until read() collects its message.
+     *
+     * @return Operation Completes when the next value has arrived
+     */
+    public function readAsync()
+    {
+        return $this->receiveAsync();
     }
 
     /**
@@ -81,6 +85,7 @@ class BidiStreamingCall extends AbstractCall
      */
     public function write($data, $options = [])
     {
+        $this->finishWrite();
         $message_array = ['message' => $data->serialize()];
         if (isset($options['flags'])) {
             $message_array['flags'] = $options['flags'];
@@ -90,11 +95,56 @@ class BidiStreamingCall extends AbstractCall
         ]);
     }
 
+    /**
+     * Start writing a single message to the server, without waiting for it
+     * to be sent. A read can be outstanding at the same time. This cannot be
+     * called after writesDone is called.
+     *
+     * @param ByteBuffer $data    The data to write
+     * @param array      $options an array of options, possible keys:
+     *                            'flags' => a number
+     *
+     * @return Operation Completes when the message has been sent
+     */
+    public function writeAsync($data, $options = [])
+    {
+        // Core takes one message at a time
+        $this->finishWrite();
+        $message_array = ['message' => $data->serialize()];
+        if (isset($options['flags'])) {
+            $message_array['flags'] = $options['flags'];
+        }
+        $this->pending_write = $this->call->startBatchAsync([
+            OP_SEND_MESSAGE => $message_array,
+        ]);
+
+        return $this->pending_write;
+    }
+
+    /**
+     * Write many messages to the server, without waiting for each one to
+     * be sent before preparing the next. This cannot be called after
+     * writesDone is called.
+     *
+     * @param array|Traversable $data    The messages to write
+     * @param array             $options an array of options, possible keys:
+     *                                   'flags' => a number
+     *                                   'window' => the number of messages
+     *                                   buffered before a flush
+     *
+     * @return int The number of messages sent
+     */
+    public function writeMany($data, $options = [])
+    {
+        return $this->writeAll($data, $options);
+    }
+
     /**
      * Indicate that no more writes will be sent.
      */
     public function writesDone()
     {
+        $this->finishWrite();
         $this->call->startBatch([
             OP_SEND_CLOSE_FROM_CLIENT => true,
         ]);
@@ -108,10 +158,6 @@ class BidiStreamingCall extends AbstractCall
      */
     public function getStatus()
     {
-        $status_event = $this->call->startBatch([
-            OP_RECV_STATUS_ON_CLIENT => true,
-        ]);
-
-        return $status_event->status;
+        return $this->receiveStatus();
     }
 }
@@ -0,0 +1,162 @@
+<?php
+/*
+ *
+ * Copyright 2015, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+namespace Grpc;
+
+/**
+ * A set of channels to one target that calls are spread over. Each channel
+ * gets its own connection, because the channels differ in the
+ * grpc.php.channel_pool_index arg, so the pool is not held back by the
+ * server's limit on concurrent streams per connection. The pool grows when
+ * every channel carries as many calls as a connection is expected to take.
+ */
+class ChannelPool
+{
+    private $target;
+    private $opts;
+    private $max_channels;
+    private $max_calls_per_channel;
+    private $channels;
+    private $methods;
+
+    /**
+     * @param string $target                The target to connect to
+     * @param array  $opts                  The args to create every channel
+     *                                      with, as for Channel
+     * @param int    $max_channels          The most channels to open
+     *                                      (optional)
+     * @param int    $max_calls_per_channel The calls a channel takes before
+     *                                      the pool opens another one; the
+     *                                      server's MAX_CONCURRENT_STREAMS
+     *                                      (optional)
+     */
+    public function __construct($target,
+                                $opts,
+                                $max_channels = 4,
+                                $max_calls_per_channel = 100)
+    {
+        if ($max_channels < 1 || $max_calls_per_channel < 1) {
+            throw new \InvalidArgumentException(
+                'ChannelPool limits must be positive');
+        }
+        $this->target = $target;
+        $this->opts = $opts;
+        $this->max_channels = $max_channels;
+        $this->max_calls_per_channel = $max_calls_per_channel;
+        $this->channels = [];
+        $this->methods = [];
+        $this->addChannel();
+    }
+
+    /**
+     * @return string The URI of the endpoint
+     */
+    public function getTarget()
+    {
+        return $this->channels[0]->getTarget();
+    }
+
+    /**
+     * @return int The number of channels opened so far
+     */
+    public function getSize()
+    {
+        return count($this->channels);
+    }
+
+    /**
+     * Pick the channel to start the next call on: the one with the fewest
+     * active calls, or a new one once all of them are full.
+     *
+     * @return Channel The channel to use
+     */
+    public function getChannel()
+    {
+        $least_loaded = null;
+        $least_calls = PHP_INT_MAX;
+        foreach ($this->channels as $channel) {
+            $calls = $channel->getActiveCallCount();
+            if ($calls < $least_calls) {
+                $least_loaded = $channel;
+                $least_calls = $calls;
+            }
+        }
+        if ($least_calls >= $this->max_calls_per_channel &&
+            count($this->channels) < $this->max_channels) {
+            return $this->addChannel();
+        }
+
+        return $least_loaded;
+    }
+
+    /**
+     * Register a method on every channel of the pool, including the ones
+     * opened later, see Channel::registerMethods.
+     *
+     * @param string $method The method name
+     */
+    public function registerMethod($method)
+    {
+        if (isset($this->methods[$method])) {
+            return;
+        }
+        $this->methods[$method] = true;
+        foreach ($this->channels as $channel) {
+            $channel->registerMethods([$method]);
+        }
+    }
+
+    /**
+     * Close every channel of the pool.
+     */
+    public function close()
+    {
+        foreach ($this->channels as $channel) {
+            $channel->close();
+        }
+    }
+
+    private function addChannel()
+    {
+        $opts = $this->opts;
+        $opts['grpc.php.channel_pool_index'] = count($this->channels);
+        $channel = new Channel($this->target, $opts);
+        if (!empty($this->methods)) {
+            $channel->registerMethods(array_keys($this->methods));
+        }
+        $this->channels[] = $channel;
+
+        return $channel;
+    }
+}
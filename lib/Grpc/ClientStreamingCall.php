@@ -56,13 +56,31 @@ class ClientStreamingCall extends AbstractCall
      * Write a single message to the server. This cannot be called after
      * wait is called.
      *
-     * @param ByteBuffer $data    The data to write
-     * @param array      $options an array of options, possible keys:
-     *                            'flags' => a number
+     * A stream resource holding an already serialized message is sent as
+     * is, without reading it into a string first. Regular files are mapped
+     * into memory, and must not be truncated until the write has been sent.
+     *
+     * @param ByteBuffer|resource $data    The data to write
+     * @param array               $options an array of options, possible keys:
+     *                                     'flags' => a number
+     *                                     'offset' => where in the stream
+     *                                     the message starts
+     *                                     'length' => the size of the
+     *                                     message in the stream
      */
     public function write($data, $options = [])
     {
-        $message_array = ['message' => $data->serialize()];
+        $this->finishWrite();
+        if (is_resource($data)) {
+            $message_array = ['stream' => $data];
+            foreach (['offset', 'length'] as $key) {
+                if (isset($options[$key])) {
+                    $message_array[$key] = $options[$key];
+                }
+            }
+        } else {
+            $message_array = ['message' => $data->serialize()];
+        }
         if (isset($options['flags'])) {
             $message_array['flags'] = $options['flags'];
         }
@@ -71,6 +89,24 @@ class ClientStreamingCall extends AbstractCall
         ]);
     }
 
+    /**
+     * Write many messages to the server, without waiting for each one to
+     * be sent before preparing the next. This cannot be called after
+     * wait is called.
+     *
+     * @param array|Traversable $data    The messages to write
+     * @param array             $options an array of options, possible keys:
+     *                                   'flags' => a number
+     *                                   'window' => the number of messages
+     *                                   buffered before a flush
+     *
+     * @return int The number of messages sent
+     */
+    public function writeMany($data, $options = [])
+    {
+        return $this->writeAll($data, $options);
+    }
+
     /**
      * Wait for the server to respond with data and a status.
      *
@@ -78,6 +114,7 @@ class ClientStreamingCall extends AbstractCall
      */
     public function wait()
     {
+        $this->finishWrite();
         $event = $this->call->startBatch([
             OP_SEND_CLOSE_FROM_CLIENT => true,
             OP_RECV_INITIAL_METADATA => true,
@@ -86,6 +123,7 @@ class ClientStreamingCall extends AbstractCall
         ]);
         $this->metadata = $event->metadata;
 
-        return [$this->deserializeResponse($event->message), $event->status];
+        return [$this->deserializeResponse($event->message),
+                $this->convertStatus($event->status)];
     }
 }
@@ -0,0 +1,253 @@
+<?php
+/*
+ *
+ * Copyright 2015, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+namespace Grpc;
+
+/**
+ * Serves one address from several worker processes, so that a server
+ * implemented in PHP can use more than one core. Every worker is forked
+ * before it creates any gRPC object and binds the address with its own
+ * Server, completion queue and SO_REUSEPORT socket; the kernel spreads the
+ * connections over them. Workers that die are forked again.
+ *
+ * grpc_init() already ran in the parent when the extension was loaded, so
+ * the workers inherit that state of core. That only works while the parent
+ * has not created any gRPC object, which would start core's threads and
+ * pollers before the fork. For the same reason server credentials are only
+ * built in the workers.
+ *
+ * The extension also created its default completion queue when it was
+ * loaded, so every worker inherits the same one. The workers' Servers do
+ * not use it, but Channels do unless given a queue of their own: a worker
+ * that makes client calls should create its Channels with
+ * 'completion_queue' => true, so that they do not poll a queue shared with
+ * the other workers.
+ */
+class PreforkServer
+{
+    private $address;
+    private $serve;
+    private $workers;
+    private $args;
+    private $credentials;
+    private $respawn_delay;
+    private $running;
+    private $pids;
+
+    /**
+     * @param string   $address The address to bind, with a fixed port
+     * @param callable $serve   Runs a worker: takes the bound Server, which
+     *                          it may register methods on before starting
+     *                          it, and the index of the worker. Returns the
+     *                          exit code of the worker
+     * @param array    $options An array of options, possible keys:
+     *                          'workers' => the number of worker processes,
+     *                          by default one per CPU
+     *                          'args' => the args to create the Servers
+     *                          with. Each Server gets a completion queue of
+     *                          its own whatever 'completion_queue' says
+     *                          'credentials' => a callable that returns
+     *                          the ServerCredentials, called in each
+     *                          worker, or an array of PEM strings for
+     *                          ServerCredentials::createSsl with the keys
+     *                          'pem_root_certs' (optional),
+     *                          'pem_private_key' and 'pem_cert_chain', to
+     *                          bind a secure port
+     *                          'respawn_delay' => the seconds to wait before
+     *                          forking again a worker that died within a
+     *                          second of starting (default 1)
+     */
+    public function __construct($address, callable $serve, $options = [])
+    {
+        $workers = isset($options['workers']) ? $options['workers'] :
+            self::cpuCount();
+        if ($workers < 1) {
+            throw new \InvalidArgumentException(
+                'PreforkServer needs at least one worker');
+        }
+        $this->address = $address;
+        $this->serve = $serve;
+        $this->workers = $workers;
+        $this->args = isset($options['args']) ? $options['args'] : [];
+        $this->args['grpc.so_reuseport'] = 1;
+        // Not the shared default queue, which the parent's module set up
+        $this->args['completion_queue'] = true;
+        $this->credentials = isset($options['credentials']) ?
+            $options['credentials'] : null;
+        if ($this->credentials !== null &&
+            !is_callable($this->credentials) &&
+            !(is_array($this->credentials) &&
+              isset($this->credentials['pem_private_key'],
+                    $this->credentials['pem_cert_chain']))) {
+            // Credentials made here would be core objects created before
+            // the fork
+            throw new \InvalidArgumentException(
+                'PreforkServer credentials must be a callable or an array '.
+                'of PEM strings');
+        }
+        $this->respawn_delay = isset($options['respawn_delay']) ?
+            $options['respawn_delay'] : 1;
+        $this->running = false;
+        $this->pids = [];
+    }
+
+    /**
+     * Fork the workers and supervise them until stop() is called or the
+     * process gets SIGTERM or SIGINT, which are passed on to the workers.
+     * Must be called before this process creates any gRPC object.
+     */
+    public function run()
+    {
+        if (!function_exists('pcntl_async_signals') ||
+            !function_exists('posix_kill')) {
+            throw new \RuntimeException('PreforkServer requires PHP 7.1 '.
+                                        'and the pcntl and posix extensions');
+        }
+        $this->running = true;
+        $stop = function () {
+            $this->stop();
+        };
+        // Run the handlers as the signals arrive, without restarting
+        // pcntl_wait, so that the signals end it
+        $async_signals = pcntl_async_signals(true);
+        pcntl_signal(SIGTERM, $stop, false);
+        pcntl_signal(SIGINT, $stop, false);
+        for ($i = 0; $i < $this->workers; ++$i) {
+            $this->fork($i);
+        }
+        while ($this->running) {
+            $pid = pcntl_wait($status);
+            if ($pid <= 0 || !isset($this->pids[$pid])) {
+                continue;
+            }
+            list($index, $started) = $this->pids[$pid];
+            unset($this->pids[$pid]);
+            if (!$this->running) {
+                break;
+            }
+            if (microtime(true) - $started < 1) {
+                // Do not fork in a loop when workers fail on start up
+                sleep($this->respawn_delay);
+            }
+            $this->fork($index);
+        }
+        foreach ($this->pids as $pid => $worker) {
+            posix_kill($pid, SIGTERM);
+        }
+        while (!empty($this->pids)) {
+            $pid = pcntl_wait($status);
+            if ($pid > 0) {
+                unset($this->pids[$pid]);
+            }
+        }
+        pcntl_signal(SIGTERM, SIG_DFL);
+        pcntl_signal(SIGINT, SIG_DFL);
+        pcntl_async_signals($async_signals);
+    }
+
+    /**
+     * Make run() stop the workers and return.
+     */
+    public function stop()
+    {
+        $this->running = false;
+    }
+
+    /**
+     * @return int The number of worker processes
+     */
+    public function getWorkerCount()
+    {
+        return $this->workers;
+    }
+
+    private function fork($index)
+    {
+        $pid = pcntl_fork();
+        if ($pid == -1) {
+            throw new \RuntimeException('PreforkServer failed to fork');
+        }
+        if ($pid == 0) {
+            pcntl_signal(SIGTERM, SIG_DFL);
+            pcntl_signal(SIGINT, SIG_DFL);
+            try {
+                $code = $this->serveWorker($index);
+            } catch (\Throwable $e) {
+                fwrite(STDERR, 'PreforkServer worker '.$index.': '.$e.
+                       PHP_EOL);
+                $code = 1;
+            }
+            // Never return into the supervisor loop of the parent
+            exit($code);
+        }
+        $this->pids[$pid] = [$index, microtime(true)];
+    }
+
+    private function serveWorker($index)
+    {
+        $server = new Server($this->args);
+        if ($this->credentials === null) {
+            $port = $server->addHttp2Port($this->address);
+        } else {
+            $credentials = is_callable($this->credentials) ?
+                call_user_func($this->credentials) :
+                ServerCredentials::createSsl(
+                    isset($this->credentials['pem_root_certs']) ?
+                    $this->credentials['pem_root_certs'] : null,
+                    $this->credentials['pem_private_key'],
+                    $this->credentials['pem_cert_chain']);
+            $port = $server->addSecureHttp2Port($this->address,
+                                                $credentials);
+        }
+        if ($port == 0) {
+            fwrite(STDERR, 'PreforkServer worker '.$index.
+                   ' failed to bind '.$this->address.PHP_EOL);
+
+            return 1;
+        }
+        $code = call_user_func($this->serve, $server, $index);
+
+        return is_int($code) ? $code : 0;
+    }
+
+    private static function cpuCount()
+    {
+        $cpuinfo = @file_get_contents('/proc/cpuinfo');
+        if ($cpuinfo === false) {
+            return 1;
+        }
+
+        return max(1, preg_match_all('/^processor\s*:/m', $cpuinfo));
+    }
+}
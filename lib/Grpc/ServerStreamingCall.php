@@ -68,14 +68,10 @@ class ServerStreamingCall extends AbstractCall
      */
     public function responses()
     {
-        $response = $this->call->startBatch([
-            OP_RECV_MESSAGE => true,
-        ])->message;
+        $response = $this->receive();
         while ($response !== null) {
             yield $this->deserializeResponse($response);
-            $response = $this->call->startBatch([
-                OP_RECV_MESSAGE => true,
-            ])->message;
+            $response = $this->receive();
         }
     }
 
@@ -87,10 +83,6 @@ class ServerStreamingCall extends AbstractCall
      */
     public function getStatus()
     {
-        $status_event = $this->call->startBatch([
-            OP_RECV_STATUS_ON_CLIENT => true,
-        ]);
-
-        return $status_event->status;
+        return $this->receiveStatus();
     }
 }
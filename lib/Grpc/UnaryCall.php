@@ -40,8 +40,16 @@ namespace Grpc;
  */
 class UnaryCall extends AbstractCall
 {
+    // the pending batch of the call, until its results are collected
+    private $operation;
+
+    // the results of the single batch of the call
+    private $event;
+
     /**
-     * Start the call.
+     * Start the call. All of the call's ops go out in one batch, which is
+     * only submitted here, so that many calls can be started before waiting
+     * on any of them.
      *
      * @param $data The data to send
      * @param array $metadata Metadata to send with the call, if applicable
@@ -50,17 +58,10 @@ class UnaryCall extends AbstractCall
      */
     public function start($data, $metadata = [], $options = [])
     {
-        $message_array = ['message' => $data->serialize()];
-        if (isset($options['flags'])) {
-            $message_array['flags'] = $options['flags'];
-        }
-        $event = $this->call->startBatch([
-            OP_SEND_INITIAL_METADATA => $metadata,
-            OP_RECV_INITIAL_METADATA => true,
-            OP_SEND_MESSAGE => $message_array,
-            OP_SEND_CLOSE_FROM_CLIENT => true,
-        ]);
-        $this->metadata = $event->metadata;
+        $this->operation = $this->call->unaryAsync(
+            $data->serialize(),
+            $metadata,
+            isset($options['flags']) ? $options['flags'] : 0);
     }
 
     /**
@@ -70,11 +71,55 @@ class UnaryCall extends AbstractCall
      */
     public function wait()
     {
-        $event = $this->call->startBatch([
-            OP_RECV_MESSAGE => true,
-            OP_RECV_STATUS_ON_CLIENT => true,
-        ]);
+        $event = $this->collect();
+
+        return [$this->deserializeResponse($event->message),
+                $this->convertStatus($event->status)];
+    }
+
+    /**
+     * @return The metadata sent by the server. Waits for the response.
+     */
+    public function getMetadata()
+    {
+        $this->collect();
+
+        return parent::getMetadata();
+    }
+
+    /**
+     * @return Operation The pending batch of the call, to wait on together
+     *                   with others, or null once its results are collected
+     */
+    public function getOperation()
+    {
+        return $this->operation;
+    }
+
+    /**
+     * Wait for the batch of the call, once. The wait is bounded by
+     * grpc.wait_timeout_ms like startBatch.
+     *
+     * @return The results of the batch
+     */
+    private function collect()
+    {
+        if ($this->event === null) {
+            $event = $this->operation->wait();
+            if ($event === null) {
+                throw new \RuntimeException(
+                    'Waiting for the call returned no results');
+            }
+            if (isset($event->operation)) {
+                // Gave up waiting without cancelling the call, so the next
+                // wait() waits for it again
+                return $event;
+            }
+            $this->event = $event;
+            $this->operation = null;
+            $this->metadata = $event->metadata;
+        }
 
-        return [$this->deserializeResponse($event->message), $event->status];
+        return $this->event;
     }
 }
@@ -224,6 +224,29 @@ abstract class AbstractGeneratedCodeTest extends PHPUnit_Framework_TestCase
         $this->assertSame(\Grpc\STATUS_OK, $status->code);
     }
 
+    public function testSimpleRequestMany()
+    {
+        $div_args = [];
+        for ($i = 0; $i < 5; ++$i) {
+            $div_args[$i] = new math\DivArgs();
+            $div_args[$i]->setDividend(10 + $i);
+            $div_args[$i]->setDivisor(3);
+        }
+        $results = self::$client->_simpleRequestMany(
+            '/math.Math/Div',
+            $div_args,
+            '\math\DivReply::deserialize',
+            [],
+            ['concurrency' => 2]);
+        $this->assertSame([0, 1, 2, 3, 4], array_keys($results));
+        foreach ($results as $i => $result) {
+            list($response, $status) = $result;
+            $this->assertSame(intdiv(10 + $i, 3), $response->getQuotient());
+            $this->assertSame((10 + $i) % 3, $response->getRemainder());
+            $this->assertSame(\Grpc\STATUS_OK, $status->code);
+        }
+    }
+
     public function testServerStreaming()
     {
         $fib_arg = new math\FibArgs();
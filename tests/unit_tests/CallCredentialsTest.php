@@ -96,10 +96,10 @@ class CallCredentialsTest extends PHPUnit_Framework_TestCase
 
         $event = $this->server->requestCall();
 
-        $this->assertTrue(is_array($event->metadata));
+        $this->assertInstanceOf('Grpc\Metadata', $event->metadata);
         $metadata = $event->metadata;
-        $this->assertTrue(array_key_exists('k1', $metadata));
-        $this->assertTrue(array_key_exists('k2', $metadata));
+        $this->assertTrue(isset($metadata['k1']));
+        $this->assertTrue(isset($metadata['k2']));
         $this->assertSame($metadata['k1'], ['v1']);
         $this->assertSame($metadata['k2'], ['v2']);
 
@@ -125,9 +125,9 @@ class CallCredentialsTest extends PHPUnit_Framework_TestCase
             Grpc\OP_RECV_STATUS_ON_CLIENT => true,
         ]);
 
-        $this->assertSame([], $event->metadata);
+        $this->assertSame([], $event->metadata->toArray());
         $status = $event->status;
-        $this->assertSame([], $status->metadata);
+        $this->assertSame([], $status->metadata->toArray());
         $this->assertSame(Grpc\STATUS_OK, $status->code);
         $this->assertSame($status_text, $status->details);
 
@@ -91,6 +91,55 @@ class CallTest extends PHPUnit_Framework_TestCase
         $this->assertTrue($result->send_metadata);
     }
 
+    public function testAddMetadataTemplate()
+    {
+        $template = new Grpc\MetadataTemplate(['Key1' => ['value1'],
+                                               'key2' => ['value2']]);
+        $combined = $template->with(['key2' => ['value3'],
+                                     'key3' => ['value4']]);
+        $this->assertSame(['key1' => ['value1'], 'key2' => ['value2']],
+                          $template->toArray());
+        $this->assertSame(['key1' => ['value1'], 'key2' => ['value3'],
+                           'key3' => ['value4']],
+                          $combined->toArray());
+        $batch = [
+            Grpc\OP_SEND_INITIAL_METADATA => $combined,
+        ];
+        $result = $this->call->startBatch($batch);
+        $this->assertTrue($result->send_metadata);
+    }
+
+    /**
+     * @expectedException InvalidArgumentException
+     */
+    public function testInvalidMetadataTemplateKey()
+    {
+        new Grpc\MetadataTemplate(['invalid key' => ['value']]);
+    }
+
+    public function testInvalidMetadataTemplateWith()
+    {
+        $template = new Grpc\MetadataTemplate(['key1' => ['value1']]);
+        try {
+            $template->with(['key2' => ['value2'],
+                             'invalid key' => ['value']]);
+            $this->fail('Expected an InvalidArgumentException');
+        } catch (InvalidArgumentException $e) {
+        }
+        $this->assertSame(['key1' => ['value1']], $template->toArray());
+    }
+
+    public function testStartBatchAsync()
+    {
+        $operation = $this->call->startBatchAsync([
+            Grpc\OP_SEND_INITIAL_METADATA => [],
+        ]);
+        $this->assertSame('Grpc\Operation', get_class($operation));
+        $result = $operation->wait();
+        $this->assertTrue($operation->isDone());
+        $this->assertTrue($result->send_metadata);
+    }
+
     public function testGetPeer()
     {
         $this->assertTrue(is_string($this->call->getPeer()));
@@ -112,6 +161,17 @@ class CallTest extends PHPUnit_Framework_TestCase
         $result = $this->call->startBatch($batch);
     }
 
+    /**
+     * @expectedException InvalidArgumentException
+     */
+    public function testStartBatchAsyncInvalidMetadataKey()
+    {
+        $batch = [
+            'invalid' => ['key1' => 'value1'],
+        ];
+        $this->call->startBatchAsync($batch);
+    }
+
     /**
      * @expectedException InvalidArgumentException
      */
@@ -0,0 +1,88 @@
+<?php
+/*
+ *
+ * Copyright 2015, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+class ChannelPoolTest extends PHPUnit_Framework_TestCase
+{
+    public function setUp()
+    {
+        $this->pool = new Grpc\ChannelPool('localhost:0', [], 2, 1);
+    }
+
+    public function tearDown()
+    {
+        $this->pool->close();
+    }
+
+    public function testActiveCallCount()
+    {
+        $channel = new Grpc\Channel('localhost:0', []);
+        $this->assertSame(0, $channel->getActiveCallCount());
+        $call = new Grpc\Call($channel,
+                              '/foo',
+                              Grpc\Timeval::infFuture());
+        $this->assertSame(1, $channel->getActiveCallCount());
+        unset($call);
+        $this->assertSame(0, $channel->getActiveCallCount());
+    }
+
+    public function testGrowsWhenChannelsAreFull()
+    {
+        $deadline = Grpc\Timeval::infFuture();
+        $this->assertSame('localhost:0', $this->pool->getTarget());
+        $this->assertSame(1, $this->pool->getSize());
+        $first = $this->pool->getChannel();
+        $this->assertSame($first, $this->pool->getChannel());
+
+        $first_call = new Grpc\Call($first, '/foo', $deadline);
+        $second = $this->pool->getChannel();
+        $this->assertNotSame($first, $second);
+        $this->assertSame(2, $this->pool->getSize());
+
+        $second_call = new Grpc\Call($second, '/foo', $deadline);
+        $this->pool->getChannel();
+        $this->assertSame(2, $this->pool->getSize());
+
+        unset($first_call);
+        $this->assertSame($first, $this->pool->getChannel());
+        unset($second_call);
+    }
+
+    /**
+     * @expectedException InvalidArgumentException
+     */
+    public function testInvalidLimits()
+    {
+        new Grpc\ChannelPool('localhost:0', [], 0);
+    }
+}
@@ -78,4 +78,63 @@ class ChannelTest extends PHPUnit_Framework_TestCase
             ]
         );
     }
+
+    public function testCompletionQueueArg()
+    {
+        $queue = new Grpc\CompletionQueue();
+        $this->channel = new Grpc\Channel('localhost:0',
+                                          ['completion_queue' => $queue]);
+        $this->assertSame('localhost:0', $this->channel->getTarget());
+        $channel = new Grpc\Channel('localhost:0',
+                                    ['completion_queue' => true]);
+        $this->assertSame('localhost:0', $channel->getTarget());
+    }
+
+    /**
+     * @expectedException InvalidArgumentException
+     */
+    public function testInvalidCompletionQueueArg()
+    {
+        $this->channel = new Grpc\Channel(
+            'localhost:0',
+            [
+                'completion_queue' => new Grpc\Timeval(100),
+            ]
+        );
+    }
+
+    public function testPersistentChannel()
+    {
+        $this->channel = new Grpc\Channel('localhost:0',
+                                          ['persistent' => true]);
+        $channel = new Grpc\Channel('localhost:0', ['persistent' => true]);
+        $this->assertSame('localhost:0', $channel->getTarget());
+        $channel->close();
+        $this->assertSame('localhost:0', $this->channel->getTarget());
+        $state = $this->channel->getConnectivityState();
+        $this->assertTrue(is_int($state));
+    }
+
+    public function testRegisterMethods()
+    {
+        $this->channel = new Grpc\Channel('localhost:0', []);
+        $this->channel->registerMethods(['/foo', '/bar']);
+        $this->channel->registerMethods(['/foo'], 'host');
+        $call = new Grpc\Call($this->channel, '/foo',
+                               Grpc\Timeval::infFuture());
+        $this->assertInstanceOf('Grpc\Call', $call);
+        $call = new Grpc\Call($this->channel, '/foo',
+                               Grpc\Timeval::infFuture(), 'host');
+        $this->assertInstanceOf('Grpc\Call', $call);
+    }
+
+    /**
+     * @expectedException InvalidArgumentException
+     */
+    public function testRegisterMethodsOnClosedChannel()
+    {
+        $this->channel = new Grpc\Channel('localhost:0', []);
+        $this->channel->close();
+        $this->channel->registerMethods(['/foo']);
+    }
 }
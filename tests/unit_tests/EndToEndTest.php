@@ -87,7 +87,7 @@ class EndToEndTest extends PHPUnit_Framework_TestCase
         ]);
 
         $status = $event->status;
-        $this->assertSame([], $status->metadata);
+        $this->assertSame([], $status->metadata->toArray());
         $this->assertSame(Grpc\STATUS_OK, $status->code);
         $this->assertSame($status_text, $status->details);
 
@@ -133,7 +133,7 @@ class EndToEndTest extends PHPUnit_Framework_TestCase
         ]);
 
         $status = $event->status;
-        $this->assertSame([], $status->metadata);
+        $this->assertSame([], $status->metadata->toArray());
         $this->assertSame(Grpc\STATUS_OK, $status->code);
         $this->assertSame($status_text, $status->details);
 
@@ -190,10 +190,10 @@ class EndToEndTest extends PHPUnit_Framework_TestCase
             Grpc\OP_RECV_STATUS_ON_CLIENT => true,
         ]);
 
-        $this->assertSame([], $event->metadata);
+        $this->assertSame([], $event->metadata->toArray());
         $this->assertSame($reply_text, $event->message);
         $status = $event->status;
-        $this->assertSame([], $status->metadata);
+        $this->assertSame([], $status->metadata->toArray());
         $this->assertSame(Grpc\STATUS_OK, $status->code);
         $this->assertSame($status_text, $status->details);
 
@@ -201,9 +201,1050 @@ class EndToEndTest extends PHPUnit_Framework_TestCase
         unset($server_call);
     }
 
+    public function testAsyncClientServerFullRequestResponse()
+    {
+        $deadline = Grpc\Timeval::infFuture();
+        $req_text = 'async_client_server_full_request_response';
+        $reply_text = 'reply:async_client_server_full_request_response';
+        $status_text = 'status:async_client_server_full_response_text';
+
+        $call = new Grpc\Call($this->channel,
+                              'dummy_method',
+                              $deadline);
+
+        $send_op = $call->startBatchAsync([
+            Grpc\OP_SEND_INITIAL_METADATA => [],
+            Grpc\OP_SEND_CLOSE_FROM_CLIENT => true,
+            Grpc\OP_SEND_MESSAGE => ['message' => $req_text],
+        ]);
+        $recv_op = $call->startBatchAsync([
+            Grpc\OP_RECV_INITIAL_METADATA => true,
+            Grpc\OP_RECV_MESSAGE => true,
+            Grpc\OP_RECV_STATUS_ON_CLIENT => true,
+        ]);
+        $this->assertFalse($recv_op->isDone());
+
+        $event = $this->server->requestCall();
+        $this->assertSame('dummy_method', $event->method);
+        $server_call = $event->call;
+
+        $event = $server_call->startBatch([
+            Grpc\OP_SEND_INITIAL_METADATA => [],
+            Grpc\OP_SEND_MESSAGE => ['message' => $reply_text],
+            Grpc\OP_SEND_STATUS_FROM_SERVER => [
+                'metadata' => [],
+                'code' => Grpc\STATUS_OK,
+                'details' => $status_text,
+            ],
+            Grpc\OP_RECV_MESSAGE => true,
+            Grpc\OP_RECV_CLOSE_ON_SERVER => true,
+        ]);
+        $this->assertSame($req_text, $event->message);
+
+        $event = $send_op->wait();
+        $this->assertTrue($event->send_metadata);
+        $this->assertTrue($event->send_close);
+        $this->assertTrue($event->send_message);
+
+        $event = $recv_op->wait();
+        $this->assertTrue($recv_op->isDone());
+        $this->assertSame($reply_text, $event->message);
+        $status = $event->status;
+        $this->assertSame(Grpc\STATUS_OK, $status->code);
+        $this->assertSame($status_text, $status->details);
+        $this->assertSame($event, $recv_op->wait());
+
+        unset($call);
+        unset($server_call);
+    }
+
+    public function testWaitAnyAndWaitAll()
+    {
+        $deadline = Grpc\Timeval::infFuture();
+        $calls = [];
+        $operations = [];
+        foreach (['first', 'second'] as $name) {
+            $call = new Grpc\Call($this->channel,
+                                  'dummy_method',
+                                  $deadline);
+            $call->startBatch([
+                Grpc\OP_SEND_INITIAL_METADATA => [],
+                Grpc\OP_SEND_CLOSE_FROM_CLIENT => true,
+            ]);
+            $operations[$name] = $call->startBatchAsync([
+                Grpc\OP_RECV_STATUS_ON_CLIENT => true,
+            ]);
+            $calls[$name] = $call;
+        }
+
+        $this->assertSame([],
+                          Grpc\waitAny($operations, Grpc\Timeval::zero()));
+        $this->assertFalse(Grpc\waitAll($operations, Grpc\Timeval::zero()));
+
+        $server_calls = [];
+        for ($i = 0; $i < 2; ++$i) {
+            $server_call = $this->server->requestCall()->call;
+            $server_call->startBatch([
+                Grpc\OP_SEND_INITIAL_METADATA => [],
+                Grpc\OP_SEND_STATUS_FROM_SERVER => [
+                    'metadata' => [],
+                    'code' => Grpc\STATUS_OK,
+                    'details' => 'done',
+                ],
+                Grpc\OP_RECV_CLOSE_ON_SERVER => true,
+            ]);
+            $server_calls[] = $server_call;
+            if ($i == 0) {
+                $done = Grpc\waitAny($operations);
+                $this->assertCount(1, $done);
+            }
+        }
+
+        $this->assertTrue(Grpc\waitAll($operations));
+        $this->assertSame(['first', 'second'], Grpc\waitAny($operations));
+        foreach ($operations as $operation) {
+            $this->assertSame(Grpc\STATUS_OK,
+                              $operation->wait()->status->code);
+        }
+
+        unset($calls);
+        unset($server_calls);
+    }
+
+    public function testWaitAnyAcrossCompletionQueues()
+    {
+        $deadline = Grpc\Timeval::infFuture();
+        $queue = new Grpc\CompletionQueue();
+        $channel = new Grpc\Channel('localhost:'.$this->port,
+                                    ['completion_queue' => $queue]);
+        $calls = [
+            'default' => new Grpc\Call($this->channel,
+                                       'dummy_method',
+                                       $deadline),
+            'own' => new Grpc\Call($channel, 'dummy_method', $deadline),
+        ];
+        $operations = [];
+        foreach ($calls as $name => $call) {
+            $operations[$name] = $call->startBatchAsync([
+                Grpc\OP_SEND_INITIAL_METADATA => [],
+                Grpc\OP_SEND_CLOSE_FROM_CLIENT => true,
+                Grpc\OP_RECV_STATUS_ON_CLIENT => true,
+            ]);
+        }
+
+        $server_calls = [];
+        for ($i = 0; $i < 2; ++$i) {
+            $server_call = $this->server->requestCall()->call;
+            $server_call->startBatch([
+                Grpc\OP_SEND_INITIAL_METADATA => [],
+                Grpc\OP_SEND_STATUS_FROM_SERVER => [
+                    'metadata' => [],
+                    'code' => Grpc\STATUS_OK,
+                    'details' => '',
+                ],
+                Grpc\OP_RECV_CLOSE_ON_SERVER => true,
+            ]);
+            $server_calls[] = $server_call;
+        }
+
+        $this->assertTrue(Grpc\waitAll($operations));
+        foreach ($operations as $operation) {
+            $this->assertSame(Grpc\STATUS_OK,
+                              $operation->wait()->status->code);
+        }
+
+        unset($calls);
+        unset($server_calls);
+    }
+
+    public function testDrainWithEventNotifier()
+    {
+        $deadline = Grpc\Timeval::infFuture();
+        $call = new Grpc\Call($this->channel,
+                              'dummy_method',
+                              $deadline);
+        $call->startBatch([
+            Grpc\OP_SEND_INITIAL_METADATA => [],
+            Grpc\OP_SEND_CLOSE_FROM_CLIENT => true,
+        ]);
+        $operation = $call->startBatchAsync([
+            Grpc\OP_RECV_INITIAL_METADATA => true,
+            Grpc\OP_RECV_STATUS_ON_CLIENT => true,
+        ]);
+        $this->assertSame([], Grpc\drain());
+
+        $notifier = Grpc\getEventNotifier();
+        $this->assertTrue(is_resource($notifier));
+
+        $server_call = $this->server->requestCall()->call;
+        $server_call->startBatch([
+            Grpc\OP_SEND_INITIAL_METADATA => [],
+            Grpc\OP_SEND_STATUS_FROM_SERVER => [
+                'metadata' => [],
+                'code' => Grpc\STATUS_OK,
+                'details' => 'done',
+            ],
+            Grpc\OP_RECV_CLOSE_ON_SERVER => true,
+        ]);
+
+        $completed = [];
+        while (count($completed) == 0) {
+            $read = [$notifier];
+            $write = $except = null;
+            $this->assertGreaterThan(0,
+                                     stream_select($read, $write, $except, 5));
+            $completed = Grpc\drain();
+        }
+        $this->assertCount(1, $completed);
+        $this->assertSame($operation, $completed[0]);
+        $this->assertSame(Grpc\STATUS_OK,
+                          $operation->wait()->status->code);
+        $this->assertSame([], Grpc\drain());
+
+        Grpc\stopEventNotifier();
+        stream_get_contents($notifier);
+        $this->assertTrue(feof($notifier));
+
+        unset($call);
+        unset($server_call);
+    }
+
+    public function testCallCredentialsWithEventNotifier()
+    {
+        Grpc\getEventNotifier();
+        try {
+            Grpc\CallCredentials::createFromPlugin(function ($context) {
+                return [];
+            });
+            $this->fail('Expected a LogicException');
+        } catch (LogicException $e) {
+        } finally {
+            Grpc\stopEventNotifier();
+        }
+        $this->assertInstanceOf('Grpc\CallCredentials',
+            Grpc\CallCredentials::createFromPlugin(function ($context) {
+                return [];
+            }));
+    }
+
+    public function testStartBatchWaitTimeout()
+    {
+        $deadline = Grpc\Timeval::infFuture();
+        $call = new Grpc\Call($this->channel,
+                              'dummy_method',
+                              $deadline);
+        $call->startBatch([
+            Grpc\OP_SEND_INITIAL_METADATA => [],
+        ]);
+
+        ini_set('grpc.cancel_on_timeout', '0');
+        $event = $call->startBatch([
+            Grpc\OP_RECV_STATUS_ON_CLIENT => true,
+        ], new Grpc\Timeval(1000));
+        ini_restore('grpc.cancel_on_timeout');
+        $this->assertTrue($event->timed_out);
+        $this->assertFalse($event->operation->isDone());
+
+        $call->cancel();
+        $status = $event->operation->wait()->status;
+        $this->assertSame(Grpc\STATUS_CANCELLED, $status->code);
+
+        unset($call);
+    }
+
+    public function testStartBatchWaitTimeoutCancels()
+    {
+        $deadline = Grpc\Timeval::infFuture();
+        $call = new Grpc\Call($this->channel,
+                              'dummy_method',
+                              $deadline);
+        ini_set('grpc.wait_timeout_ms', '1');
+        $event = $call->startBatch([
+            Grpc\OP_SEND_INITIAL_METADATA => [],
+            Grpc\OP_RECV_STATUS_ON_CLIENT => true,
+        ]);
+        ini_restore('grpc.wait_timeout_ms');
+        $this->assertTrue($event->timed_out);
+        $this->assertSame(Grpc\STATUS_CANCELLED, $event->status->code);
+
+        unset($call);
+    }
+
+    public function testWaitAnyWaitTimeout()
+    {
+        $deadline = Grpc\Timeval::infFuture();
+        $call = new Grpc\Call($this->channel,
+                              'dummy_method',
+                              $deadline);
+        $operation = $call->startBatchAsync([
+            Grpc\OP_SEND_INITIAL_METADATA => [],
+            Grpc\OP_RECV_STATUS_ON_CLIENT => true,
+        ]);
+        ini_set('grpc.wait_timeout_ms', '1');
+        $this->assertSame([], Grpc\waitAny([$operation]));
+        $this->assertFalse(Grpc\waitAll([$operation]));
+        ini_restore('grpc.wait_timeout_ms');
+        $this->assertFalse($operation->isDone());
+
+        unset($operation);
+        unset($call);
+    }
+
+    public function testRequestCallWaitTimeout()
+    {
+        $deadline = Grpc\Timeval::infFuture();
+        $this->assertNull($this->server->requestCall(new Grpc\Timeval(1000)));
+
+        $call = new Grpc\Call($this->channel,
+                              'dummy_method',
+                              $deadline);
+        $call->startBatch([
+            Grpc\OP_SEND_INITIAL_METADATA => [],
+        ]);
+        $event = $this->server->requestCall();
+        $this->assertSame('dummy_method', $event->method);
+
+        unset($call);
+    }
+
+    public function testLargeMessageSentOnManyCalls()
+    {
+        $deadline = Grpc\Timeval::infFuture();
+        $req_text = str_repeat('large_message', 100000);
+
+        for ($i = 0; $i < 2; ++$i) {
+            $call = new Grpc\Call($this->channel,
+                                  'dummy_method',
+                                  $deadline);
+            $event = $call->startBatch([
+                Grpc\OP_SEND_INITIAL_METADATA => [],
+                Grpc\OP_SEND_CLOSE_FROM_CLIENT => true,
+                Grpc\OP_SEND_MESSAGE => ['message' => $req_text],
+            ]);
+            $this->assertTrue($event->send_message);
+
+            $server_call = $this->server->requestCall()->call;
+            $event = $server_call->startBatch([
+                Grpc\OP_SEND_INITIAL_METADATA => [],
+                Grpc\OP_SEND_STATUS_FROM_SERVER => [
+                    'metadata' => [],
+                    'code' => Grpc\STATUS_OK,
+                    'details' => '',
+                ],
+                Grpc\OP_RECV_MESSAGE => true,
+                Grpc\OP_RECV_CLOSE_ON_SERVER => true,
+            ]);
+            $this->assertSame($req_text, $event->message);
+
+            unset($call);
+            unset($server_call);
+        }
+    }
+
+    public function testRequestEndsWithSendInFlight()
+    {
+        // The server never reads, so the send is still in flight when the
+        // child's request ends and its memory is freed
+        $script = tempnam(sys_get_temp_dir(), 'grpc');
+        file_put_contents($script, '<?php
+            $server = new Grpc\Server([]);
+            $port = $server->addHttp2Port("0.0.0.0:0");
+            $server->start();
+            $channel = new Grpc\Channel("localhost:".$port, []);
+            $call = new Grpc\Call($channel, "dummy_method",
+                                  Grpc\Timeval::infFuture());
+            $operation = $call->startBatchAsync([
+                Grpc\OP_SEND_INITIAL_METADATA => [],
+                Grpc\OP_SEND_MESSAGE => [
+                    "message" => str_repeat("large_message", 400000),
+                ],
+            ]);
+            echo "sent";
+        ');
+        $command = 'exec '.escapeshellarg(PHP_BINARY).
+            ' -d '.escapeshellarg('extension_dir='.ini_get('extension_dir')).
+            ' -d extension=grpc.so -d grpc.wait_timeout_ms=100 '.
+            escapeshellarg($script);
+        $process = proc_open($command, [
+            1 => ['pipe', 'w'],
+            2 => ['file', '/dev/null', 'w'],
+        ], $pipes);
+        $deadline = microtime(true) + 30;
+        $status = proc_get_status($process);
+        while ($status['running'] && microtime(true) < $deadline) {
+            usleep(10000);
+            $status = proc_get_status($process);
+        }
+        if ($status['running']) {
+            proc_terminate($process, 9);
+        }
+        $output = stream_get_contents($pipes[1]);
+        fclose($pipes[1]);
+        proc_close($process);
+        unlink($script);
+
+        $this->assertFalse($status['running']);
+        $this->assertSame(0, $status['exitcode']);
+        $this->assertSame('sent', $output);
+    }
+
+    public function testReceiveMessageAsByteBuffer()
+    {
+        $deadline = Grpc\Timeval::infFuture();
+        $req_text = str_repeat('large_message', 100000);
+
+        $call = new Grpc\Call($this->channel,
+                              'dummy_method',
+                              $deadline);
+        $event = $call->startBatch([
+            Grpc\OP_SEND_INITIAL_METADATA => [],
+            Grpc\OP_SEND_CLOSE_FROM_CLIENT => true,
+            Grpc\OP_SEND_MESSAGE => ['message' => $req_text],
+        ]);
+        $this->assertTrue($event->send_message);
+
+        $server_call = $this->server->requestCall()->call;
+        $event = $server_call->startBatch([
+            Grpc\OP_SEND_INITIAL_METADATA => [],
+            Grpc\OP_SEND_STATUS_FROM_SERVER => [
+                'metadata' => [],
+                'code' => Grpc\STATUS_OK,
+                'details' => '',
+            ],
+            Grpc\OP_RECV_MESSAGE => ['byte_buffer' => true],
+            Grpc\OP_RECV_CLOSE_ON_SERVER => true,
+        ]);
+        $buffer = $event->message;
+        $this->assertInstanceOf('Grpc\ByteBuffer', $buffer);
+        $this->assertSame(strlen($req_text), $buffer->length());
+        $this->assertSame(substr($req_text, 13, 26), $buffer->read(13, 26));
+        $this->assertSame($req_text, $buffer->read());
+        $this->assertSame($req_text, implode('', iterator_to_array($buffer)));
+
+        $stream = fopen('php://memory', 'w+');
+        $this->assertSame(strlen($req_text), $buffer->writeTo($stream));
+        rewind($stream);
+        $this->assertSame($req_text, stream_get_contents($stream));
+        fclose($stream);
+
+        unset($call);
+        unset($server_call);
+    }
+
+    public function testByteBufferCannotBeConstructedOrCloned()
+    {
+        try {
+            new Grpc\ByteBuffer();
+            $this->fail('ByteBuffer was constructed');
+        } catch (Error $e) {
+        }
+
+        $call = new Grpc\Call($this->channel,
+                              'dummy_method',
+                              Grpc\Timeval::infFuture());
+        $call->startBatch([
+            Grpc\OP_SEND_INITIAL_METADATA => [],
+            Grpc\OP_SEND_CLOSE_FROM_CLIENT => true,
+            Grpc\OP_SEND_MESSAGE => ['message' => 'message'],
+        ]);
+        $server_call = $this->server->requestCall()->call;
+        $event = $server_call->startBatch([
+            Grpc\OP_RECV_MESSAGE => ['byte_buffer' => true],
+        ]);
+        try {
+            clone $event->message;
+            $this->fail('ByteBuffer was cloned');
+        } catch (Error $e) {
+        }
+        $this->assertSame('message', (string)$event->message);
+
+        $call->cancel();
+        unset($call);
+        unset($server_call);
+    }
+
+    public function testSendMessageFromFile()
+    {
+        $deadline = Grpc\Timeval::infFuture();
+        $req_text = str_repeat('large_message', 100000);
+        $path = tempnam(sys_get_temp_dir(), 'grpc');
+        file_put_contents($path, 'head'.$req_text);
+        $stream = fopen($path, 'rb');
+
+        foreach ([['stream' => $stream, 'offset' => 4],
+                  ['file' => $path, 'offset' => 4,
+                   'length' => strlen($req_text)]] as $message) {
+            $call = new Grpc\Call($this->channel,
+                                  'dummy_method',
+                                  $deadline);
+            $event = $call->startBatch([
+                Grpc\OP_SEND_INITIAL_METADATA => [],
+                Grpc\OP_SEND_CLOSE_FROM_CLIENT => true,
+                Grpc\OP_SEND_MESSAGE => $message,
+            ]);
+            $this->assertTrue($event->send_message);
+
+            $server_call = $this->server->requestCall()->call;
+            $event = $server_call->startBatch([
+                Grpc\OP_SEND_INITIAL_METADATA => [],
+                Grpc\OP_SEND_STATUS_FROM_SERVER => [
+                    'metadata' => [],
+                    'code' => Grpc\STATUS_OK,
+                    'details' => '',
+                ],
+                Grpc\OP_RECV_MESSAGE => true,
+                Grpc\OP_RECV_CLOSE_ON_SERVER => true,
+            ]);
+            $this->assertSame($req_text, $event->message);
+
+            unset($call);
+            unset($server_call);
+        }
+        $this->assertSame(strlen($req_text) + 4, ftell($stream));
+        fclose($stream);
+        unlink($path);
+    }
+
     /**
      * @expectedException InvalidArgumentException
      */
+    public function testSendMessageFileRangeOutOfBounds()
+    {
+        $path = tempnam(sys_get_temp_dir(), 'grpc');
+        file_put_contents($path, 'message');
+        $call = new Grpc\Call($this->channel,
+                              'dummy_method',
+                              Grpc\Timeval::infFuture());
+        try {
+            $call->startBatch([
+                Grpc\OP_SEND_MESSAGE => ['file' => $path, 'offset' => 4,
+                                         'length' => 10],
+            ]);
+        } finally {
+            unlink($path);
+        }
+    }
+
+    /**
+     * @expectedException InvalidArgumentException
+     */
+    public function testSendMessageFileWithNullByte()
+    {
+        $call = new Grpc\Call($this->channel,
+                              'dummy_method',
+                              Grpc\Timeval::infFuture());
+        $call->startBatch([
+            Grpc\OP_SEND_MESSAGE => ['file' => "/etc/hosts\0.txt"],
+        ]);
+    }
+
+    public function testUnaryCall()
+    {
+        $deadline = Grpc\Timeval::infFuture();
+        $req_text = 'client_server_full_request_response';
+        $reply_text = 'reply:client_server_full_request_response';
+        $status_text = 'status:client_server_full_response_text';
+        $call = new Grpc\Call($this->channel,
+                              'dummy_method',
+                              $deadline);
+
+        // Give up waiting, so that the server can answer the call
+        ini_set('grpc.cancel_on_timeout', '0');
+        $unary_event = $call->unary($req_text, ['k' => ['v']], 0,
+                                    new Grpc\Timeval(1000));
+        ini_restore('grpc.cancel_on_timeout');
+        $this->assertTrue($unary_event->timed_out);
+
+        $event = $this->server->requestCall();
+        $this->assertSame(['v'], $event->metadata['k']);
+        $server_call = $event->call;
+        $event = $server_call->startBatch([
+            Grpc\OP_SEND_INITIAL_METADATA => [],
+            Grpc\OP_RECV_MESSAGE => true,
+            Grpc\OP_SEND_MESSAGE => ['message' => $reply_text],
+            Grpc\OP_SEND_STATUS_FROM_SERVER => [
+                'metadata' => [],
+                'code' => Grpc\STATUS_OK,
+                'details' => $status_text,
+            ],
+            Grpc\OP_RECV_CLOSE_ON_SERVER => true,
+        ]);
+        $this->assertSame($req_text, $event->message);
+
+        $event = $unary_event->operation->wait();
+        $this->assertSame([], $event->metadata->toArray());
+        $this->assertSame($reply_text, $event->message);
+        $this->assertSame(Grpc\STATUS_OK, $event->status->code);
+        $this->assertSame($status_text, $event->status->details);
+
+        unset($call);
+        unset($server_call);
+    }
+
+    public function testUnaryAsync()
+    {
+        $deadline = Grpc\Timeval::infFuture();
+        $calls = [];
+        $operations = [];
+        for ($i = 0; $i < 2; ++$i) {
+            $calls[$i] = new Grpc\Call($this->channel,
+                                        'dummy_method',
+                                        $deadline);
+            $operations[$i] = $calls[$i]->unaryAsync('request'.$i, []);
+            $this->assertInstanceOf('Grpc\Operation', $operations[$i]);
+        }
+
+        for ($i = 0; $i < 2; ++$i) {
+            $server_call = $this->server->requestCall()->call;
+            $event = $server_call->startBatch([
+                Grpc\OP_SEND_INITIAL_METADATA => [],
+                Grpc\OP_RECV_MESSAGE => true,
+            ]);
+            $server_call->startBatch([
+                Grpc\OP_SEND_MESSAGE => ['message' => 'reply:'.$event->message],
+                Grpc\OP_SEND_STATUS_FROM_SERVER => [
+                    'metadata' => [],
+                    'code' => Grpc\STATUS_OK,
+                    'details' => '',
+                ],
+                Grpc\OP_RECV_CLOSE_ON_SERVER => true,
+            ]);
+        }
+
+        for ($i = 0; $i < 2; ++$i) {
+            $event = $operations[$i]->wait();
+            $this->assertSame('reply:request'.$i, $event->message);
+            $this->assertSame(Grpc\STATUS_OK, $event->status->code);
+        }
+
+        unset($calls);
+        unset($server_call);
+    }
+
+    public function testRequestSlots()
+    {
+        $server = new Grpc\Server(['grpc.php.request_slots' => 2]);
+        $port = $server->addHttp2Port('0.0.0.0:0');
+        $channel = new Grpc\Channel('localhost:'.$port, []);
+        $server->start();
+
+        $this->assertNull($server->requestCall(Grpc\Timeval::zero()));
+        $calls = [];
+        for ($i = 0; $i < 3; ++$i) {
+            $calls[$i] = new Grpc\Call($channel,
+                                        'method'.$i,
+                                        Grpc\Timeval::infFuture());
+            $calls[$i]->startBatch([
+                Grpc\OP_SEND_INITIAL_METADATA => [],
+            ]);
+        }
+        // Core matches calls to the posted requests in no set order
+        $methods = [];
+        for ($i = 0; $i < 3; ++$i) {
+            $event = $server->requestCall();
+            $methods[] = $event->method;
+        }
+        sort($methods);
+        $this->assertSame(['method0', 'method1', 'method2'], $methods);
+
+        unset($calls);
+        unset($event);
+        unset($channel);
+        unset($server);
+    }
+
+    public function testRequestSlotsSingleCall()
+    {
+        $server = new Grpc\Server(['grpc.php.request_slots' => 4]);
+        $port = $server->addHttp2Port('0.0.0.0:0');
+        $channel = new Grpc\Channel('localhost:'.$port, []);
+        $server->start();
+
+        // Posts all four requests
+        $this->assertNull($server->requestCall(Grpc\Timeval::zero()));
+        $call = new Grpc\Call($channel,
+                               'single_method',
+                               Grpc\Timeval::infFuture());
+        $call->startBatch([
+            Grpc\OP_SEND_INITIAL_METADATA => [],
+        ]);
+        // Whichever request core matched, the call is returned
+        $event = $server->requestCall(new Grpc\Timeval(5000000));
+        $this->assertNotNull($event);
+        $this->assertSame('single_method', $event->method);
+        $this->assertNull($server->requestCall(Grpc\Timeval::zero()));
+
+        unset($call);
+        unset($event);
+        unset($channel);
+        unset($server);
+    }
+
+    public function testRegisteredMethod()
+    {
+        $server = new Grpc\Server([]);
+        $server->registerMethod('registered_method');
+        $port = $server->addHttp2Port('0.0.0.0:0');
+        $channel = new Grpc\Channel('localhost:'.$port, []);
+        $server->start();
+
+        $call = new Grpc\Call($channel,
+                               'registered_method',
+                               Grpc\Timeval::infFuture());
+        $call->startBatch([
+            Grpc\OP_SEND_INITIAL_METADATA => ['k' => ['v']],
+            Grpc\OP_SEND_MESSAGE => ['message' => 'request'],
+            Grpc\OP_SEND_CLOSE_FROM_CLIENT => true,
+        ]);
+
+        $event = $server->requestRegisteredCall('registered_method');
+        $this->assertSame('registered_method', $event->method);
+        $this->assertSame('request', $event->message);
+        $this->assertSame(['v'], $event->metadata['k']);
+        $server_call = $event->call;
+        $server_call->startBatch([
+            Grpc\OP_SEND_INITIAL_METADATA => [],
+            Grpc\OP_SEND_STATUS_FROM_SERVER => [
+                'metadata' => [],
+                'code' => Grpc\STATUS_OK,
+                'details' => '',
+            ],
+            Grpc\OP_RECV_CLOSE_ON_SERVER => true,
+        ]);
+
+        $event = $call->startBatch([
+            Grpc\OP_RECV_STATUS_ON_CLIENT => true,
+        ]);
+        $this->assertSame(Grpc\STATUS_OK, $event->status->code);
+
+        unset($call);
+        unset($server_call);
+        unset($channel);
+        unset($server);
+    }
+
+    /**
+     * Answers the next unary call to the test server with $reply.
+     */
+    private function answerUnaryCall($reply)
+    {
+        $server_call = $this->server->requestCall()->call;
+        $server_call->startBatch([
+            Grpc\OP_SEND_INITIAL_METADATA => [],
+            Grpc\OP_RECV_MESSAGE => true,
+            Grpc\OP_SEND_MESSAGE => ['message' => $reply],
+            Grpc\OP_SEND_STATUS_FROM_SERVER => [
+                'metadata' => [],
+                'code' => Grpc\STATUS_OK,
+                'details' => '',
+            ],
+            Grpc\OP_RECV_CLOSE_ON_SERVER => true,
+        ]);
+
+        return $server_call;
+    }
+
+    public function testUnaryCallWaitTimeout()
+    {
+        $call = new Grpc\UnaryCall($this->channel,
+                                    'dummy_method',
+                                    function ($value) { return $value; });
+        $call->start(new EndToEndTestMessage('request'));
+
+        // Gives up without cancelling, so the call can still be answered
+        ini_set('grpc.cancel_on_timeout', '0');
+        ini_set('grpc.wait_timeout_ms', '1');
+        list($response, $status) = $call->wait();
+        ini_restore('grpc.wait_timeout_ms');
+        ini_restore('grpc.cancel_on_timeout');
+        $this->assertNull($response);
+        $this->assertNull($status);
+
+        $server_call = $this->answerUnaryCall('reply');
+        list($response, $status) = $call->wait();
+        $this->assertSame('reply', $response);
+        $this->assertSame(Grpc\STATUS_OK, $status->code);
+
+        unset($call);
+        unset($server_call);
+    }
+
+    public function testUnaryCallWaitTimeoutCancels()
+    {
+        $call = new Grpc\UnaryCall($this->channel,
+                                    'dummy_method',
+                                    function ($value) { return $value; });
+        $call->start(new EndToEndTestMessage('request'));
+
+        ini_set('grpc.wait_timeout_ms', '1');
+        list($response, $status) = $call->wait();
+        ini_restore('grpc.wait_timeout_ms');
+        $this->assertNull($response);
+        $this->assertSame(Grpc\STATUS_CANCELLED, $status->code);
+
+        unset($call);
+    }
+
+    public function testReceivedMetadata()
+    {
+        $deadline = Grpc\Timeval::infFuture();
+        $call = new Grpc\Call($this->channel,
+                              'dummy_method',
+                              $deadline);
+        $call->startBatch([
+            Grpc\OP_SEND_INITIAL_METADATA => [],
+        ]);
+
+        $server_call = $this->server->requestCall()->call;
+        $server_call->startBatch([
+            Grpc\OP_SEND_INITIAL_METADATA => [
+                'k1' => ['v1', 'v2'],
+                'k2' => ['v3'],
+            ],
+        ]);
+
+        $metadata = $call->startBatch([
+            Grpc\OP_RECV_INITIAL_METADATA => true,
+        ])->metadata;
+        $this->assertInstanceOf('Grpc\Metadata', $metadata);
+        $this->assertTrue(isset($metadata['k1']));
+        $this->assertFalse(isset($metadata['k3']));
+        $this->assertSame(['v1', 'v2'], $metadata['k1']);
+        $this->assertNull($metadata['k3']);
+        $this->assertSame(2, count($metadata));
+        $this->assertSame(['k1' => ['v1', 'v2'], 'k2' => ['v3']],
+                          iterator_to_array($metadata));
+        $this->assertSame(['v3'], $metadata['k2']);
+
+        unset($call);
+        unset($server_call);
+    }
+
+    /**
+     * @expectedException LogicException
+     */
+    public function testReceivedMetadataIsReadOnly()
+    {
+        $deadline = Grpc\Timeval::infFuture();
+        $call = new Grpc\Call($this->channel,
+                              'dummy_method',
+                              $deadline);
+        $call->startBatch([
+            Grpc\OP_SEND_INITIAL_METADATA => ['k1' => ['v1']],
+        ]);
+        $metadata = $this->server->requestCall()->metadata;
+        $metadata['k1'] = ['v2'];
+    }
+
+    public function testWriteMany()
+    {
+        $deadline = Grpc\Timeval::infFuture();
+        $messages = ['message1', 'message2', str_repeat('message3', 1000)];
+        $call = new Grpc\Call($this->channel,
+                              'dummy_method',
+                              $deadline);
+        $call->startBatch([
+            Grpc\OP_SEND_INITIAL_METADATA => [],
+        ]);
+        $this->assertSame(3, $call->writeMany($messages));
+        $this->assertSame(0, $call->writeMany([]));
+
+        $server_call = $this->server->requestCall()->call;
+        foreach ($messages as $message) {
+            $event = $server_call->startBatch([
+                Grpc\OP_RECV_MESSAGE => true,
+            ]);
+            $this->assertSame($message, $event->message);
+        }
+
+        unset($call);
+        unset($server_call);
+    }
+
+    public function testWriteManyTraversable()
+    {
+        $deadline = Grpc\Timeval::infFuture();
+        $messages = ['message1', 'message2'];
+        $call = new Grpc\Call($this->channel,
+                              'dummy_method',
+                              $deadline);
+        $call->startBatch([
+            Grpc\OP_SEND_INITIAL_METADATA => [],
+        ]);
+        $pending = 'unset';
+        $this->assertSame(2, $call->writeMany(new ArrayIterator($messages),
+                                              0, $pending));
+        $this->assertNull($pending);
+
+        $server_call = $this->server->requestCall()->call;
+        foreach ($messages as $message) {
+            $event = $server_call->startBatch([
+                Grpc\OP_RECV_MESSAGE => true,
+            ]);
+            $this->assertSame($message, $event->message);
+        }
+
+        unset($call);
+        unset($server_call);
+    }
+
+    /**
+     * @expectedException InvalidArgumentException
+     */
+    public function testWriteManyInvalidMessage()
+    {
+        $call = new Grpc\Call($this->channel,
+                              'dummy_method',
+                              Grpc\Timeval::infFuture());
+        $call->writeMany(['message', 1]);
+    }
+
+    public function testWriteWhileReceivePosted()
+    {
+        $deadline = Grpc\Timeval::infFuture();
+        $call = new Grpc\Call($this->channel,
+                              'dummy_method',
+                              $deadline);
+        $call->startBatch([
+            Grpc\OP_SEND_INITIAL_METADATA => [],
+        ]);
+        $read = $call->startBatchAsync([
+            Grpc\OP_RECV_INITIAL_METADATA => true,
+            Grpc\OP_RECV_MESSAGE => true,
+        ]);
+
+        // The posted receive does not hold up sends
+        $event = $call->startBatch([
+            Grpc\OP_SEND_MESSAGE => ['message' => 'request'],
+        ]);
+        $this->assertTrue($event->send_message);
+        $this->assertFalse($read->isDone());
+
+        $server_call = $this->server->requestCall()->call;
+        $event = $server_call->startBatch([
+            Grpc\OP_SEND_INITIAL_METADATA => [],
+            Grpc\OP_RECV_MESSAGE => true,
+            Grpc\OP_SEND_MESSAGE => ['message' => 'response'],
+        ]);
+        $this->assertSame('request', $event->message);
+
+        $this->assertSame('response', $read->wait()->message);
+
+        unset($call);
+        unset($server_call);
+    }
+
+    public function testReadAheadWaitTimeoutCancels()
+    {
+        $call = new Grpc\BidiStreamingCall($this->channel,
+                                            'dummy_method',
+                                            function ($value) {
+                                                return $value;
+                                            },
+                                            ['read_ahead' => true]);
+        $call->start();
+        $server_call = $this->server->requestCall()->call;
+        $server_call->startBatch([
+            Grpc\OP_SEND_INITIAL_METADATA => [],
+            Grpc\OP_SEND_MESSAGE => ['message' => 'first'],
+        ]);
+        // Posts the receive for the next message before returning
+        $this->assertSame('first', $call->read());
+
+        ini_set('grpc.wait_timeout_ms', '1');
+        $this->assertNull($call->read());
+        ini_restore('grpc.wait_timeout_ms');
+        $this->assertSame(Grpc\STATUS_CANCELLED, $call->getStatus()->code);
+
+        unset($call);
+        unset($server_call);
+    }
+
+    public function testRunBatchTemplate()
+    {
+        $deadline = Grpc\Timeval::infFuture();
+        $req_text = 'client_server_full_request_response';
+        $status_text = 'status:client_server_full_response_text';
+        $client_batch = new Grpc\Batch([
+            Grpc\OP_SEND_INITIAL_METADATA => true,
+            Grpc\OP_SEND_CLOSE_FROM_CLIENT => true,
+            Grpc\OP_SEND_MESSAGE => ['flags' => 0],
+        ]);
+        $server_batch = new Grpc\Batch([
+            Grpc\OP_SEND_INITIAL_METADATA => true,
+            Grpc\OP_SEND_STATUS_FROM_SERVER => true,
+            Grpc\OP_RECV_MESSAGE => true,
+            Grpc\OP_RECV_CLOSE_ON_SERVER => true,
+        ]);
+        $this->assertSame(2, $client_batch->getArgumentCount());
+        $this->assertSame(4, $server_batch->getArgumentCount());
+
+        for ($i = 0; $i < 2; ++$i) {
+            $call = new Grpc\Call($this->channel,
+                                  'dummy_method',
+                                  $deadline);
+            $event = $call->runBatch($client_batch, [[], $req_text]);
+            $this->assertInstanceOf('Grpc\BatchResult', $event);
+            $this->assertTrue($event->send_metadata);
+            $this->assertTrue($event->send_close);
+            $this->assertTrue($event->send_message);
+            $this->assertNull($event->message);
+
+            $server_call = $this->server->requestCall()->call;
+            $event = $server_call->runBatch($server_batch, [
+                [],
+                [],
+                Grpc\STATUS_OK,
+                $status_text,
+            ]);
+            $this->assertTrue($event->send_metadata);
+            $this->assertTrue($event->send_status);
+            $this->assertFalse($event->cancelled);
+            $this->assertSame($req_text, $event->message);
+
+            $event = $call->startBatch([
+                Grpc\OP_RECV_INITIAL_METADATA => true,
+                Grpc\OP_RECV_STATUS_ON_CLIENT => true,
+            ]);
+            $this->assertInstanceOf('Grpc\BatchResult', $event);
+            $this->assertSame(Grpc\STATUS_OK, $event->status->code);
+            $this->assertSame($status_text, $event->status->details);
+
+            unset($call);
+            unset($server_call);
+        }
+    }
+
+    public function testBatchCannotBeConstructedTwice()
+    {
+        $batch = new Grpc\Batch([
+            Grpc\OP_SEND_INITIAL_METADATA => true,
+            Grpc\OP_SEND_MESSAGE => true,
+        ]);
+        try {
+            $batch->__construct([
+                Grpc\OP_SEND_STATUS_FROM_SERVER => true,
+            ]);
+            $this->fail('Batch was constructed twice');
+        } catch (LogicException $e) {
+        }
+        $this->assertSame(2, $batch->getArgumentCount());
+    }
+
+    /**
+     * @expectedException InvalidArgumentException
+     */
+    public function testRunBatchWrongValueCount()
+    {
+        $call = new Grpc\Call($this->channel,
+                              'dummy_method',
+                              Grpc\Timeval::infFuture());
+        $call->runBatch(new Grpc\Batch([
+            Grpc\OP_SEND_INITIAL_METADATA => true,
+            Grpc\OP_SEND_MESSAGE => true,
+        ]), [[]]);
+    }
+
     public function testInvalidClientMessageArray()
     {
         $deadline = Grpc\Timeval::infFuture();
@@ -600,3 +1641,21 @@ class EndToEndTest extends PHPUnit_Framework_TestCase
         $this->assertNull($this->channel->close());
     }
 }
+
+/**
+ * A request message for the call wrappers, which only need serialize().
+ */
+class EndToEndTestMessage
+{
+    private $data;
+
+    public function __construct($data)
+    {
+        $this->data = $data;
+    }
+
+    public function serialize()
+    {
+        return $this->data;
+    }
+}
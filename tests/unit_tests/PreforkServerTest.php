@@ -0,0 +1,180 @@
+<?php
+/*
+ *
+ * Copyright 2015, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+class PreforkServerTest extends PHPUnit_Framework_TestCase
+{
+    public function testWorkerCount()
+    {
+        $serve = function ($server, $index) {
+            return 0;
+        };
+        $server = new Grpc\PreforkServer('0.0.0.0:50051', $serve,
+                                         ['workers' => 3]);
+        $this->assertSame(3, $server->getWorkerCount());
+        $server = new Grpc\PreforkServer('0.0.0.0:50051', $serve);
+        $this->assertGreaterThanOrEqual(1, $server->getWorkerCount());
+    }
+
+    public function testRespawnsKilledWorker()
+    {
+        if (!function_exists('pcntl_async_signals') ||
+            !function_exists('posix_kill')) {
+            $this->markTestSkipped('PreforkServer needs pcntl and posix');
+        }
+        $socket = stream_socket_server('tcp://127.0.0.1:0');
+        $port = parse_url(stream_socket_get_name($socket, false),
+                          PHP_URL_PORT);
+        fclose($socket);
+        $dir = tempnam(sys_get_temp_dir(), 'grpc');
+        unlink($dir);
+        mkdir($dir);
+        // run() needs a process that has not created any gRPC object yet
+        $script = $dir.'/server.php';
+        file_put_contents($script, '<?php
+            require '.var_export(__DIR__.'/../../lib/Grpc/PreforkServer.php',
+                                 true).';
+            $serve = function ($server, $index) {
+                $server->start();
+                file_put_contents('.var_export($dir, true).
+                                  '."/worker".$index, getmypid());
+                while (true) {
+                    $call = $server->requestCall()->call;
+                    $call->startBatch([
+                        Grpc\OP_SEND_INITIAL_METADATA => [],
+                        Grpc\OP_SEND_STATUS_FROM_SERVER => [
+                            "metadata" => [],
+                            "code" => Grpc\STATUS_OK,
+                            "details" => (string)getmypid(),
+                        ],
+                        Grpc\OP_RECV_CLOSE_ON_SERVER => true,
+                    ]);
+                }
+            };
+            $server = new Grpc\PreforkServer("127.0.0.1:'.$port.'", $serve,
+                                             ["workers" => 2,
+                                              "respawn_delay" => 0]);
+            $server->run();
+        ');
+        // exec, so that the signals reach PHP rather than the shell
+        $command = 'exec '.escapeshellarg(PHP_BINARY).
+            ' -d '.escapeshellarg('extension_dir='.ini_get('extension_dir')).
+            ' -d extension=grpc.so '.escapeshellarg($script);
+        $process = proc_open($command, [2 => ['file', '/dev/null', 'w']],
+                             $pipes);
+
+        $pids = $this->waitForWorkers($dir, []);
+        $this->assertContains($this->callWorker($port), $pids);
+
+        posix_kill($pids[0], SIGKILL);
+        $respawned = $this->waitForWorkers($dir, [$pids[0]]);
+        $this->assertNotContains($pids[0], $respawned);
+        $this->assertSame($pids[1], $respawned[1]);
+        $this->assertContains($this->callWorker($port), $respawned);
+
+        proc_terminate($process, SIGTERM);
+        $this->assertSame(0, proc_close($process));
+        array_map('unlink', glob($dir.'/*'));
+        rmdir($dir);
+    }
+
+    /**
+     * Waits until both workers have written their pids, and none of them
+     * is one of the old pids
+     */
+    private function waitForWorkers($dir, $old_pids)
+    {
+        $deadline = microtime(true) + 30;
+        while (microtime(true) < $deadline) {
+            $pids = [];
+            foreach ([0, 1] as $index) {
+                $pid = @file_get_contents($dir.'/worker'.$index);
+                if ($pid && !in_array((int)$pid, $old_pids)) {
+                    $pids[] = (int)$pid;
+                }
+            }
+            if (count($pids) == 2) {
+                return $pids;
+            }
+            usleep(10000);
+        }
+        $this->fail('PreforkServer workers did not start');
+    }
+
+    /**
+     * Makes a call to the workers, retrying while a connection to a killed
+     * worker is still being replaced. Returns the pid of the worker
+     */
+    private function callWorker($port)
+    {
+        $deadline = microtime(true) + 30;
+        do {
+            $channel = new Grpc\Channel('localhost:'.$port, []);
+            $call = new Grpc\Call($channel, 'dummy_method',
+                                  Grpc\Timeval::infFuture());
+            $event = $call->startBatch([
+                Grpc\OP_SEND_INITIAL_METADATA => [],
+                Grpc\OP_SEND_CLOSE_FROM_CLIENT => true,
+                Grpc\OP_RECV_STATUS_ON_CLIENT => true,
+            ]);
+            $channel->close();
+            if ($event->status->code != Grpc\STATUS_OK) {
+                usleep(10000);
+            }
+        } while ($event->status->code != Grpc\STATUS_OK &&
+                 microtime(true) < $deadline);
+        $this->assertSame(Grpc\STATUS_OK, $event->status->code);
+
+        return (int)$event->status->details;
+    }
+
+    /**
+     * @expectedException InvalidArgumentException
+     */
+    public function testInvalidWorkerCount()
+    {
+        $server = new Grpc\PreforkServer('0.0.0.0:50051',
+                                         function ($server, $index) {},
+                                         ['workers' => 0]);
+    }
+
+    /**
+     * @expectedException InvalidArgumentException
+     */
+    public function testInvalidCredentials()
+    {
+        $server = new Grpc\PreforkServer('0.0.0.0:50051',
+                                         function ($server, $index) {},
+                                         ['credentials' => 'server.pem']);
+    }
+}
@@ -101,9 +101,9 @@ class SecureEndToEndTest extends PHPUnit_Framework_TestCase
             Grpc\OP_RECV_STATUS_ON_CLIENT => true,
         ]);
 
-        $this->assertSame([], $event->metadata);
+        $this->assertSame([], $event->metadata->toArray());
         $status = $event->status;
-        $this->assertSame([], $status->metadata);
+        $this->assertSame([], $status->metadata->toArray());
         $this->assertSame(Grpc\STATUS_OK, $status->code);
         $this->assertSame($status_text, $status->details);
 
@@ -149,9 +149,9 @@ class SecureEndToEndTest extends PHPUnit_Framework_TestCase
             Grpc\OP_RECV_STATUS_ON_CLIENT => true,
         ]);
 
-        $this->assertSame([], $event->metadata);
+        $this->assertSame([], $event->metadata->toArray());
         $status = $event->status;
-        $this->assertSame([], $status->metadata);
+        $this->assertSame([], $status->metadata->toArray());
         $this->assertSame(Grpc\STATUS_OK, $status->code);
         $this->assertSame($status_text, $status->details);
 
@@ -209,10 +209,10 @@ class SecureEndToEndTest extends PHPUnit_Framework_TestCase
             Grpc\OP_RECV_STATUS_ON_CLIENT => true,
         ]);
 
-        $this->assertSame([], $event->metadata);
+        $this->assertSame([], $event->metadata->toArray());
         $this->assertSame($reply_text, $event->message);
         $status = $event->status;
-        $this->assertSame([], $status->metadata);
+        $this->assertSame([], $status->metadata->toArray());
         $this->assertSame(Grpc\STATUS_OK, $status->code);
         $this->assertSame($status_text, $status->details);
 
@@ -67,4 +67,32 @@ class ServerTest extends PHPUnit_Framework_TestCase
         $this->server = new Grpc\Server([]);
         $this->port = $this->server->addSecureHttp2Port(['0.0.0.0:0']);
     }
+
+    /**
+     * @expectedException InvalidArgumentException
+     */
+    public function testInvalidRequestSlots()
+    {
+        $this->server = new Grpc\Server(['grpc.php.request_slots' => -1]);
+    }
+
+    /**
+     * @expectedException InvalidArgumentException
+     */
+    public function testRequestUnregisteredCall()
+    {
+        $this->server = new Grpc\Server([]);
+        $this->server->registerMethod('registered_method');
+        $this->server->requestRegisteredCall('other_method');
+    }
+
+    /**
+     * @expectedException LogicException
+     */
+    public function testRegisterMethodAfterStart()
+    {
+        $this->server = new Grpc\Server([]);
+        $this->server->start();
+        $this->server->registerMethod('registered_method');
+    }
 }